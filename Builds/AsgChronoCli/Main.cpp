@@ -0,0 +1,637 @@
+// Command line batch analyzer for raw captures (32-bit float, little endian, mono or interleaved).
+//
+// Building without Visual Studio (e.g. on Linux):
+//   g++ -std=c++11 -O2 -pthread -I../AsgChronoLib ../AsgChronoLib/*.cpp *.cpp -o asgchrono-cli
+
+#include "stdafx.h"
+#include "../AsgChronoLib/Counter.h"
+#include "../AsgChronoLib/MultiCounter.h"
+#include "../AsgChronoLib/CaptureReader.h"
+#include "../AsgChronoLib/ParallelAnalyzer.h"
+#include "../AsgChronoLib/ShotLog.h"
+#include "../AsgChronoLib/Trace.h"
+
+namespace {
+
+const size_t READ_SPAN_FRAMES = 64 * 1024;
+
+// the analysis runs much faster than real time, the log writer gets a longer queue
+const size_t LOG_QUEUE_CAPACITY = 64 * 1024;
+
+struct Options
+{
+    std::vector<std::string> files;
+    std::string csvPath;
+    std::string jsonPath;
+    std::string logPath;
+    std::string spillPath;
+    std::string readLogPath;
+    std::string encodePath;
+    std::string tracePath;
+    int bitsPerSample;
+    size_t channelsNum;
+    size_t threadsNum;
+    bool parallel;
+    size_t chunkSize;
+    bool quiet;
+    uint64_t logFirstShot;
+    uint64_t logShotsNum;
+    float logMinVelocity;
+    AsgCounterConfig config;
+
+    Options()
+        : bitsPerSample(16)
+        , channelsNum(1)
+        , threadsNum(0)
+        , parallel(false)
+        , chunkSize(0)
+        , quiet(false)
+        , logFirstShot(0)
+        , logShotsNum(UINT64_MAX)
+        , logMinVelocity(-FLT_MAX)
+    {
+    }
+};
+
+struct FileResult
+{
+    std::string path;
+    bool ok;
+    size_t samplesNum;  // all channels
+    double timeMs;
+    std::vector<std::vector<AsgStatsSample>> shots;  // per channel
+    std::vector<AsgStatsSummary> stats;  // per channel
+};
+
+void PrintUsage()
+{
+    printf("Usage: asgchrono-cli [options] file.raw [file2.raw ...]\n"
+           "       asgchrono-cli --read-log <path> [--shots <first>:<count>] [--min-velocity <m/s>]\n"
+           "       asgchrono-cli --encode <path> [--bits 16|24] [--channels <n>] [--sample-rate <hz>] file.raw\n"
+           "Use \"-\" to read a capture from the standard input. Compressed captures are recognized\n"
+           "automatically.\n"
+           "\n"
+           "Options:\n"
+           "  --csv <path>           write detected shots as CSV\n"
+           "  --json <path>          write detected shots and throughput as JSON\n"
+           "  --log <path>           write detected shots to a binary shot log (single file, not --parallel;\n"
+           "                         multiple channels are written to <path>.<channel>)\n"
+           "  --history <n>          shots kept in memory, CSV and JSON get the last n (default: all)\n"
+           "  --spill <path>         write shots dropped from the history and the kept ones at the end to a\n"
+           "                         shot log (single file, not --parallel; channels as for --log)\n"
+           "  --read-log <path>      print shots from a shot log as CSV instead of analyzing captures\n"
+           "  --encode <path>        write the capture compressed instead of analyzing it\n"
+           "  --bits <n>             compressed sample size: 16 (default) or 24\n"
+           "  --trace <path>         write Chrome trace JSON of the analysis (needs build with ASG_TRACE)\n"
+           "  --shots <first>:<count>  shots read from the log (default: all)\n"
+           "  --min-velocity <m/s>   minimum velocity of the shots read from the log\n"
+           "  --channels <n>         number of interleaved channels (default: 1)\n"
+           "  --threads <n>          worker threads (default: all cores)\n"
+           "  --parallel             split single channel files into chunks analyzed in parallel\n"
+           "  --chunk <n>            chunk size for --parallel in samples (default: split evenly)\n"
+           "  --sample-rate <hz>     sampling rate (default: 44100)\n"
+           "  --length <m>           photocell length in meters (default: 0.2)\n"
+           "  --min-distance <n>     minimum twin peaks distance in samples\n"
+           "  --max-distance <n>     maximum twin peaks distance in samples\n"
+           "  --sigma <x>            peak detection treshold\n"
+           "  --block <n>            analysis block size in samples\n"
+           "  --rms-window <n>       sliding noise floor window in samples (0 - per-block RMS)\n"
+           "  --noise <name>         sliding noise floor statistic: rms (default) or median\n"
+           "  --decimation <n>       noise floor and cross-correlation decimation (default: by sample rate)\n"
+           "  --estimator <name>     twin peaks distance estimator: hermite (default) or xcorr\n"
+           "  --highpass <hz>        pre-filter: remove DC offset and drift below the frequency\n"
+           "  --hum <hz>             pre-filter: notch mains hum (50 or 60) and its harmonics\n"
+           "  --lowpass <hz>         pre-filter: low-pass\n"
+           "  --quiet                do not print statistics\n");
+}
+
+bool ParseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg.size() < 2 || arg[0] != '-' || arg[1] != '-')
+        {
+            options.files.push_back(arg);
+            continue;
+        }
+
+        if (arg == "--quiet")
+        {
+            options.quiet = true;
+            continue;
+        }
+
+        if (arg == "--parallel")
+        {
+            options.parallel = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+
+        const char* value = argv[++i];
+        AsgCounterConfig& cfg = options.config;
+
+        if (arg == "--csv")
+            options.csvPath = value;
+        else if (arg == "--json")
+            options.jsonPath = value;
+        else if (arg == "--log")
+            options.logPath = value;
+        else if (arg == "--spill")
+            options.spillPath = value;
+        else if (arg == "--history")
+            cfg.historySize = static_cast<size_t>(std::max(atoi(value), 0));
+        else if (arg == "--read-log")
+            options.readLogPath = value;
+        else if (arg == "--encode")
+            options.encodePath = value;
+        else if (arg == "--trace")
+            options.tracePath = value;
+        else if (arg == "--bits" && (atoi(value) == 16 || atoi(value) == 24))
+            options.bitsPerSample = atoi(value);
+        else if (arg == "--shots")
+        {
+            unsigned long long first = 0, count = 0;
+            int fieldsNum = sscanf(value, "%llu:%llu", &first, &count);
+            options.logFirstShot = first;
+            options.logShotsNum = fieldsNum == 2 ? count : UINT64_MAX;
+        }
+        else if (arg == "--min-velocity")
+            options.logMinVelocity = static_cast<float>(atof(value));
+        else if (arg == "--channels")
+            options.channelsNum = std::max(atoi(value), 1);
+        else if (arg == "--threads")
+            options.threadsNum = std::max(atoi(value), 0);
+        else if (arg == "--chunk")
+            options.chunkSize = std::max(atoi(value), 0);
+        else if (arg == "--sample-rate")
+            cfg.sampleRate = static_cast<float>(atof(value));
+        else if (arg == "--length")
+            cfg.length = static_cast<float>(atof(value));
+        else if (arg == "--min-distance")
+            cfg.minPeakDistance = static_cast<size_t>(atoi(value));
+        else if (arg == "--max-distance")
+            cfg.maxPeakDistance = static_cast<size_t>(atoi(value));
+        else if (arg == "--sigma")
+            cfg.detectionSigma = static_cast<float>(atof(value));
+        else if (arg == "--block")
+            cfg.blockSize = static_cast<size_t>(atoi(value));
+        else if (arg == "--rms-window")
+            cfg.rmsWindow = static_cast<size_t>(atoi(value));
+        else if (arg == "--decimation")
+            cfg.decimation = static_cast<size_t>(atoi(value));
+        else if (arg == "--highpass")
+            cfg.highPassFrequency = static_cast<float>(atof(value));
+        else if (arg == "--hum")
+            cfg.humFrequency = static_cast<float>(atof(value));
+        else if (arg == "--lowpass")
+            cfg.lowPassFrequency = static_cast<float>(atof(value));
+        else if (arg == "--noise" && strcmp(value, "rms") == 0)
+            cfg.noiseEstimator = AsgNoiseEstimator::Rms;
+        else if (arg == "--noise" && strcmp(value, "median") == 0)
+            cfg.noiseEstimator = AsgNoiseEstimator::Median;
+        else if (arg == "--estimator" && strcmp(value, "hermite") == 0)
+            cfg.peakEstimator = AsgPeakEstimator::Hermite;
+        else if (arg == "--estimator" && strcmp(value, "xcorr") == 0)
+            cfg.peakEstimator = AsgPeakEstimator::CrossCorrelation;
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if ((!options.logPath.empty() || !options.spillPath.empty()) && (options.files.size() != 1 || options.parallel))
+    {
+        fprintf(stderr, "--log and --spill need a single capture file analyzed sequentially\n");
+        return false;
+    }
+
+    if (!options.encodePath.empty() && options.files.size() != 1)
+    {
+        fprintf(stderr, "--encode needs a single capture file\n");
+        return false;
+    }
+
+    return !options.files.empty() || !options.readLogPath.empty();
+}
+
+double SamplesPerSecond(const FileResult& result)
+{
+    return result.timeMs > 0.0 ? 1000.0 * static_cast<double>(result.samplesNum) / result.timeMs : 0.0;
+}
+
+void StoreStats(const AsgStats& stats, size_t channel, FileResult& result)
+{
+    stats.history.CopyTo(result.shots[channel]);
+    result.stats[channel] = stats;
+}
+
+void PrintThroughput(const Options& options, const FileResult& result)
+{
+    if (!options.quiet)
+        printf("Time = %.3f ms, %.1f Msamples/s\n\n", result.timeMs, SamplesPerSecond(result) / 1.0e6);
+}
+
+// one log per channel, <path>.<channel> for multiple channels
+bool OpenLogWriters(const std::string& basePath, const Options& options, std::deque<AsgShotLogWriter>& writers)
+{
+    for (size_t i = 0; i < options.channelsNum; ++i)
+    {
+        std::string path = basePath;
+        if (options.channelsNum > 1)
+            path += "." + std::to_string(i);
+
+        writers.emplace_back(LOG_QUEUE_CAPACITY);
+        if (!writers.back().Open(path.c_str(), options.config))
+        {
+            fprintf(stderr, "Failed to create %s\n", path.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CloseLogWriters(std::deque<AsgShotLogWriter>& writers)
+{
+    bool ok = true;
+    for (size_t i = 0; i < writers.size(); ++i)
+    {
+        writers[i].Close();
+        if (writers[i].GetDroppedNum() > 0)
+        {
+            fprintf(stderr, "Shot log of channel %i: %llu shots dropped\n", (int)i,
+                    (unsigned long long)writers[i].GetDroppedNum());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool AnalyzeFile(const Options& options, AsgMultiCounter& counter, AsgParallelAnalyzer& analyzer,
+                 FileResult& result)
+{
+    result.ok = false;
+    result.samplesNum = 0;
+    result.timeMs = 0.0;
+
+    AsgCaptureReader reader(options.threadsNum);
+    if (!reader.Open(result.path.c_str()))
+    {
+        fprintf(stderr, "Failed to open %s\n", result.path.c_str());
+        return false;
+    }
+
+    const size_t channelsNum = options.channelsNum;
+    const AsgCaptureFormat* format = reader.GetFormat();
+    if (format != nullptr && format->channelsNum != channelsNum)
+    {
+        fprintf(stderr, "%s has %i channels, use --channels %i\n", result.path.c_str(), (int)format->channelsNum,
+                (int)format->channelsNum);
+        return false;
+    }
+    if (format != nullptr && format->sampleRate != options.config.sampleRate)
+        fprintf(stderr, "Warning: %s was recorded at %.0f Hz, analyzing at %.0f Hz\n", result.path.c_str(),
+                format->sampleRate, options.config.sampleRate);
+
+    result.shots.resize(channelsNum);
+    result.stats.resize(channelsNum);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // the whole capture is needed at once for chunked analysis
+    if (options.parallel && channelsNum == 1 && reader.IsMapped())
+    {
+        analyzer.Analyze(reader.GetData(), reader.GetSamplesNum());
+
+        auto stop = std::chrono::steady_clock::now();
+        result.timeMs = std::chrono::duration<double, std::milli>(stop - start).count();
+        result.samplesNum = reader.GetSamplesNum();
+        StoreStats(analyzer.GetStats(), 0, result);
+        result.ok = true;
+
+        if (!options.quiet)
+        {
+            printf("======= %s =======\n", result.path.c_str());
+            analyzer.GetStats().Print();
+            printf("Chunks reanalyzed: %i\n", (int)analyzer.GetReanalyzedChunksNum());
+        }
+        PrintThroughput(options, result);
+        return true;
+    }
+
+    counter.Reset();
+
+    for (;;)
+    {
+        const float* samples;
+        size_t framesNum;
+        {
+            ASG_TRACE_SCOPE("ReadCapture");
+            framesNum = reader.Read(samples, READ_SPAN_FRAMES * channelsNum) / channelsNum;
+        }
+        if (framesNum == 0)
+            break;
+
+        if (channelsNum == 1)
+            counter.GetCounter(0).ProcessBuffer(samples, framesNum);
+        else
+            counter.ProcessInterleaved(samples, framesNum);
+
+        result.samplesNum += framesNum * channelsNum;
+    }
+
+    auto stop = std::chrono::steady_clock::now();
+    result.timeMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+    for (size_t i = 0; i < channelsNum; ++i)
+        StoreStats(counter.GetCounter(i).GetStats(), i, result);
+
+    if (!options.quiet)
+    {
+        printf("======= %s =======\n", result.path.c_str());
+        if (channelsNum == 1)
+            counter.GetCounter(0).GetStats().Print();
+        else
+            counter.Print();
+    }
+    PrintThroughput(options, result);
+
+    result.ok = true;
+    return true;
+}
+
+std::string JsonEscape(const std::string& str)
+{
+    std::string escaped;
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+bool WriteCsv(const std::string& path, const std::vector<FileResult>& results)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Failed to create %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "file,channel,shot,velocity_mps,velocity_fps,delta_time_s\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const FileResult& result = results[i];
+        for (size_t chan = 0; chan < result.shots.size(); ++chan)
+        {
+            for (size_t j = 0; j < result.shots[chan].size(); ++j)
+            {
+                const AsgStatsSample& shot = result.shots[chan][j];
+                fprintf(file, "\"%s\",%i,%i,%.3f,%.2f,%.6f\n", result.path.c_str(), (int)chan, (int)j,
+                        shot.velocity, shot.velocity > 0.0f ? shot.velocity * 3.2808f : -1.0f, shot.deltaTime);
+            }
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool WriteJson(const std::string& path, const std::vector<FileResult>& results)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Failed to create %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\n  \"files\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const FileResult& result = results[i];
+        fprintf(file, "    {\n      \"file\": \"%s\",\n      \"ok\": %s,\n", JsonEscape(result.path).c_str(),
+                result.ok ? "true" : "false");
+        fprintf(file, "      \"samples\": %llu,\n      \"time_ms\": %.3f,\n      \"samples_per_second\": %.0f,\n",
+                (unsigned long long)result.samplesNum, result.timeMs, SamplesPerSecond(result));
+        fprintf(file, "      \"channels\": [");
+
+        for (size_t chan = 0; chan < result.shots.size(); ++chan)
+        {
+            const AsgStatsSummary& stats = result.stats[chan];
+            fprintf(file, "%s\n        {\n          \"velocity_avg\": %.3f,\n          \"fire_rate_avg\": %.3f,\n",
+                    chan > 0 ? "," : "", stats.velocityAvg, stats.fireRateAvg);
+            const float fractions[] = { 0.5f, 0.95f, 0.99f };
+            float velocities[3], fireRates[3];
+            stats.velocitySketch.GetQuantiles(fractions, velocities, 3);
+            stats.fireRateSketch.GetQuantiles(fractions, fireRates, 3);
+            fprintf(file, "          \"velocity_p50\": %.3f,\n          \"velocity_p95\": %.3f,\n"
+                    "          \"velocity_p99\": %.3f,\n", velocities[0], velocities[1], velocities[2]);
+            fprintf(file, "          \"fire_rate_p50\": %.3f,\n          \"fire_rate_p95\": %.3f,\n"
+                    "          \"fire_rate_p99\": %.3f,\n          \"shots\": [", fireRates[0], fireRates[1], fireRates[2]);
+
+            for (size_t j = 0; j < result.shots[chan].size(); ++j)
+            {
+                const AsgStatsSample& shot = result.shots[chan][j];
+                fprintf(file, "%s\n            { \"velocity_mps\": %.3f, \"delta_time_s\": %.6f }",
+                        j > 0 ? "," : "", shot.velocity, shot.deltaTime);
+            }
+
+            fprintf(file, "\n          ]\n        }");
+        }
+
+        fprintf(file, "\n      ]\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    fclose(file);
+    return true;
+}
+
+bool EncodeFile(const Options& options)
+{
+    const std::string& path = options.files[0];
+    AsgCaptureReader reader(options.threadsNum);
+    if (!reader.Open(path.c_str()))
+    {
+        fprintf(stderr, "Failed to open %s\n", path.c_str());
+        return false;
+    }
+
+    AsgCaptureWriter writer(options.threadsNum);
+    if (!writer.Open(options.encodePath.c_str(), options.channelsNum, options.config.sampleRate,
+                     options.bitsPerSample))
+    {
+        fprintf(stderr, "Failed to create %s\n", options.encodePath.c_str());
+        return false;
+    }
+
+    uint64_t samplesNum = 0;
+    bool ok = true;
+    for (;;)
+    {
+        const float* samples;
+        size_t framesNum = reader.Read(samples, READ_SPAN_FRAMES * options.channelsNum) / options.channelsNum;
+        if (framesNum == 0)
+            break;
+
+        samplesNum += framesNum * options.channelsNum;
+        if (!writer.Write(samples, framesNum))
+        {
+            ok = false;
+            break;
+        }
+    }
+
+    if (!writer.Close() || !ok)
+    {
+        fprintf(stderr, "Failed to write %s\n", options.encodePath.c_str());
+        return false;
+    }
+
+    if (!options.quiet)
+        printf("%s: %llu samples, %llu bytes (%.2f times smaller)\n", options.encodePath.c_str(),
+               (unsigned long long)samplesNum, (unsigned long long)writer.GetBytesNum(),
+               static_cast<double>(samplesNum * sizeof(float)) / static_cast<double>(writer.GetBytesNum()));
+    if (writer.GetInexactNum() > 0)
+        fprintf(stderr, "Warning: %llu samples are not %i-bit integers, they were rounded\n",
+                (unsigned long long)writer.GetInexactNum(), options.bitsPerSample);
+
+    return true;
+}
+
+bool PrintLog(const Options& options)
+{
+    AsgShotLogReader reader;
+    if (!reader.Open(options.readLogPath.c_str()))
+    {
+        fprintf(stderr, "Failed to open shot log %s\n", options.readLogPath.c_str());
+        return false;
+    }
+
+    std::vector<AsgLoggedShot> shots;
+    if (!reader.ReadShots(options.logFirstShot, options.logShotsNum, shots, options.logMinVelocity))
+    {
+        fprintf(stderr, "Failed to read shot log %s\n", options.readLogPath.c_str());
+        return false;
+    }
+
+    if (!options.quiet)
+        fprintf(stderr, "%llu shots logged at %.0f Hz, %i selected\n", (unsigned long long)reader.GetShotsNum(),
+                reader.GetConfig().sampleRate, (int)shots.size());
+
+    printf("shot,velocity_mps,velocity_fps,delta_time_s,position\n");
+    for (size_t i = 0; i < shots.size(); ++i)
+    {
+        const AsgStatsSample& shot = shots[i].sample;
+        printf("%llu,%.2f,%.2f,%.6f,%.2f\n", (unsigned long long)shots[i].index, shot.velocity,
+               shot.velocity > 0.0f ? shot.velocity * 3.2808f : -1.0f, shot.deltaTime, shot.position);
+    }
+
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    ASG_TRACE_THREAD_NAME("Main");
+    if (!options.tracePath.empty() && !AsgTrace::IsCompiledIn())
+        fprintf(stderr, "Warning: tracing is not compiled in, define ASG_TRACE to record events\n");
+
+    if (!options.readLogPath.empty())
+        return PrintLog(options) ? 0 : 1;
+    if (!options.encodePath.empty())
+        return EncodeFile(options) ? 0 : 1;
+
+    AsgMultiCounter counter;
+    counter.Setup(options.channelsNum, options.config, options.threadsNum);
+
+    std::deque<AsgShotLogWriter> logWriters;
+    if (!options.logPath.empty())
+    {
+        if (!OpenLogWriters(options.logPath, options, logWriters))
+            return 1;
+        counter.SetCallback([&](size_t channel, const AsgShotEvent& event) { logWriters[channel].Push(event); });
+    }
+
+    // the history spills from the counters' threads, the writers queue the shots without blocking
+    std::deque<AsgShotLogWriter> spillWriters;
+    if (!options.spillPath.empty())
+    {
+        if (!OpenLogWriters(options.spillPath, options, spillWriters))
+            return 1;
+        for (size_t i = 0; i < options.channelsNum; ++i)
+        {
+            AsgShotLogWriter& writer = spillWriters[i];
+            counter.GetCounter(i).GetStats().history.SetSpillCallback(
+                [&writer](uint64_t index, const AsgStatsSample& sample) { writer.Push(index, sample); });
+        }
+    }
+
+    AsgParallelAnalyzer analyzer(options.parallel ? options.threadsNum : 1);
+    analyzer.GetConfig() = options.config;
+    analyzer.SetChunkSize(options.chunkSize);
+
+    std::vector<FileResult> results(options.files.size());
+    size_t totalSamples = 0;
+    double totalTimeMs = 0.0;
+    bool allOk = true;
+
+    for (size_t i = 0; i < options.files.size(); ++i)
+    {
+        FileResult& result = results[i];
+        result.path = options.files[i];
+        if (!AnalyzeFile(options, counter, analyzer, result))
+        {
+            allOk = false;
+            continue;
+        }
+
+        totalSamples += result.samplesNum;
+        totalTimeMs += result.timeMs;
+    }
+
+    if (totalTimeMs > 0.0)
+        printf("Total: %i files, %llu samples, %.3f ms, %.1f Msamples/s\n", (int)results.size(),
+               (unsigned long long)totalSamples, totalTimeMs, static_cast<double>(totalSamples) / totalTimeMs / 1000.0);
+
+    if (!options.csvPath.empty() && !WriteCsv(options.csvPath, results))
+        allOk = false;
+    if (!options.jsonPath.empty() && !WriteJson(options.jsonPath, results))
+        allOk = false;
+
+    for (size_t i = 0; i < spillWriters.size(); ++i)
+        spillWriters[i].PushHistory(counter.GetCounter(i).GetStats().history);
+
+    if (!CloseLogWriters(logWriters))
+        allOk = false;
+    if (!CloseLogWriters(spillWriters))
+        allOk = false;
+
+    if (!options.tracePath.empty() && !AsgTrace::Export(options.tracePath.c_str()))
+    {
+        fprintf(stderr, "Failed to write %s\n", options.tracePath.c_str());
+        allOk = false;
+    }
+
+    return allOk ? 0 : 1;
+}
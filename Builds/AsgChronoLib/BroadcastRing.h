@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * Lock-free ring buffer for one producer thread and any number of consumers (e.g. shot events
+ * for the GUI, loggers and exporters). Every consumer owns a Reader and gets all the items pushed
+ * after the reader was created. The producer never waits - when a reader falls behind by more than
+ * the capacity, the oldest items are overwritten and counted as lost for that reader.
+ * Capacity is rounded up to a power of two, nothing is allocated after Resize().
+ */
+template<typename T>
+class AsgBroadcastRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "items are copied while they may be overwritten");
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    // Sequence is odd while the item is being written and 2 * (position + 1) once it's complete,
+    // so readers detect items overwritten during copying.
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        T item;
+    };
+
+    std::vector<Slot> slots;
+    size_t mask;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> writePos;
+
+public:
+    class Reader
+    {
+        friend class AsgBroadcastRing;
+
+        uint64_t readPos;
+        uint64_t lostNum;
+
+    public:
+        Reader()
+            : readPos(0)
+            , lostNum(0)
+        {
+        }
+
+        /**
+         * Number of items overwritten before this reader got to them.
+         */
+        uint64_t GetLostNum() const
+        {
+            return lostNum;
+        }
+    };
+
+    explicit AsgBroadcastRing(size_t capacity = 1)
+        : slots(1)
+    {
+        Resize(capacity);
+    }
+
+    /**
+     * Change capacity and drop all the items. Not thread-safe, existing readers must be recreated.
+     */
+    void Resize(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        std::vector<Slot> newSlots(size);
+        slots.swap(newSlots);
+        for (size_t i = 0; i < size; ++i)
+            slots[i].sequence.store(0, std::memory_order_relaxed);
+
+        mask = size - 1;
+        writePos.store(0, std::memory_order_relaxed);
+    }
+
+    size_t GetCapacity() const
+    {
+        return slots.size();
+    }
+
+    /**
+     * Create a reader receiving the items pushed from now on (any thread).
+     */
+    Reader CreateReader() const
+    {
+        Reader reader;
+        reader.readPos = writePos.load(std::memory_order_acquire);
+        return reader;
+    }
+
+    /**
+     * Push an item, overwriting the oldest one if the ring is full (producer thread only).
+     */
+    void Push(const T& item)
+    {
+        const uint64_t write = writePos.load(std::memory_order_relaxed);
+        Slot& slot = slots[write & mask];
+
+        slot.sequence.store(2 * write + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.item = item;
+        slot.sequence.store(2 * (write + 1), std::memory_order_release);
+
+        writePos.store(write + 1, std::memory_order_release);
+    }
+
+    /**
+     * Number of items the reader can pop.
+     */
+    size_t GetSize(const Reader& reader) const
+    {
+        const uint64_t available = writePos.load(std::memory_order_acquire) - reader.readPos;
+        return static_cast<size_t>(std::min<uint64_t>(available, slots.size()));
+    }
+
+    /**
+     * Pop items (thread owning the reader only).
+     * Returns number of items popped.
+     */
+    size_t Pop(Reader& reader, T* data, size_t maxItems)
+    {
+        size_t popped = 0;
+        while (popped < maxItems)
+        {
+            const uint64_t write = writePos.load(std::memory_order_acquire);
+            if (reader.readPos == write)
+                break;
+
+            // skip the overwritten items
+            if (write - reader.readPos > slots.size())
+            {
+                reader.lostNum += write - slots.size() - reader.readPos;
+                reader.readPos = write - slots.size();
+            }
+
+            const Slot& slot = slots[reader.readPos & mask];
+            const uint64_t expected = 2 * (reader.readPos + 1);
+            if (slot.sequence.load(std::memory_order_acquire) == expected)
+            {
+                data[popped] = slot.item;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == expected)
+                    popped++;
+                else
+                    reader.lostNum++;
+            }
+            else
+                reader.lostNum++;  // the producer has lapped the reader meanwhile
+
+            reader.readPos++;
+        }
+
+        return popped;
+    }
+
+    bool Pop(Reader& reader, T& item)
+    {
+        return Pop(reader, &item, 1) == 1;
+    }
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Little endian encoding of the binary file formats (shot log, compressed capture).
+ */
+
+inline void AsgPutU8(std::vector<uint8_t>& buffer, uint8_t value)
+{
+    buffer.push_back(value);
+}
+
+inline void AsgPutU16(std::vector<uint8_t>& buffer, uint16_t value)
+{
+    buffer.push_back(static_cast<uint8_t>(value));
+    buffer.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+inline void AsgPutU32(std::vector<uint8_t>& buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+inline void AsgPutU64(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+inline void AsgPutFloat(std::vector<uint8_t>& buffer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    AsgPutU32(buffer, bits);
+}
+
+/**
+ * Zigzag encoded variable length integer (7 bits per byte).
+ */
+inline void AsgPutVarInt(std::vector<uint8_t>& buffer, int64_t value)
+{
+    uint64_t zigzag = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    while (zigzag >= 0x80)
+    {
+        buffer.push_back(static_cast<uint8_t>(zigzag | 0x80));
+        zigzag >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(zigzag));
+}
+
+/**
+ * Decoder of a little endian buffer, reads past the end fail and return zeros.
+ */
+class AsgByteReader
+{
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool ok;
+
+    uint64_t Get(size_t bytesNum)
+    {
+        if (size - pos < bytesNum)
+        {
+            ok = false;
+            pos = size;
+            return 0;
+        }
+
+        uint64_t value = 0;
+        for (size_t i = 0; i < bytesNum; ++i)
+            value |= static_cast<uint64_t>(data[pos + i]) << (8 * i);
+        pos += bytesNum;
+        return value;
+    }
+
+public:
+    AsgByteReader(const uint8_t* data, size_t size)
+        : data(data)
+        , size(size)
+        , pos(0)
+        , ok(true)
+    {
+    }
+
+    bool IsOk() const
+    {
+        return ok;
+    }
+
+    uint8_t GetU8() { return static_cast<uint8_t>(Get(1)); }
+    uint16_t GetU16() { return static_cast<uint16_t>(Get(2)); }
+    uint32_t GetU32() { return static_cast<uint32_t>(Get(4)); }
+    uint64_t GetU64() { return Get(8); }
+
+    float GetFloat()
+    {
+        uint32_t bits = GetU32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    int64_t GetVarInt()
+    {
+        uint64_t zigzag = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos == size)
+            {
+                ok = false;
+                return 0;
+            }
+
+            uint8_t byte = data[pos++];
+            zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        return static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+    }
+};
+
+// 64-bit file offsets ====
+
+inline bool AsgSeekFile(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+inline uint64_t AsgGetFileSize(FILE* file)
+{
+#ifdef _WIN32
+    _fseeki64(file, 0, SEEK_END);
+    return static_cast<uint64_t>(_ftelli64(file));
+#else
+    fseeko(file, 0, SEEK_END);
+    return static_cast<uint64_t>(ftello(file));
+#endif
+}
+
+/**
+ * Read size bytes at offset into buffer (resized to size).
+ */
+inline bool AsgReadBytes(FILE* file, uint64_t offset, size_t size, std::vector<uint8_t>& buffer)
+{
+    buffer.resize(size);
+    return AsgSeekFile(file, offset) && fread(buffer.data(), 1, size, file) == size;
+}
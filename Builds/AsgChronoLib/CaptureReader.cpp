@@ -0,0 +1,278 @@
+#include "stdafx.h"
+#include "CaptureReader.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// read ahead of the mapped capture, renewed when half of it was read
+const size_t PREFETCH_SAMPLES = 4 * 1024 * 1024 / sizeof(float);
+
+} // namespace
+
+AsgCaptureReader::AsgCaptureReader(size_t decodeThreadsNum)
+    : mappedData(nullptr)
+    , mappedSamplesNum(0)
+    , readPos(0)
+    , prefetchPos(0)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE)
+    , mappingHandle(nullptr)
+#else
+    , fileDesc(-1)
+    , mappedBytes(0)
+#endif
+    , stream(nullptr)
+    , ownsStream(false)
+    , decodeThreadsNum(decodeThreadsNum)
+{
+}
+
+AsgCaptureReader::~AsgCaptureReader()
+{
+    Close();
+}
+
+bool AsgCaptureReader::Open(const char* path)
+{
+    Close();
+
+    if (strcmp(path, "-") == 0)
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        stream = stdin;
+        ownsStream = false;
+        return true;
+    }
+
+    if (AsgCaptureDecoder::IsCompressed(path))
+    {
+        decoder.reset(new AsgCaptureDecoder(decodeThreadsNum));
+        if (decoder->Open(path))
+            return true;
+
+        decoder.reset();
+        return false;
+    }
+
+    if (Map(path))
+        return true;
+
+    // not a regular file (pipe, device) or out of address space - stream it
+    stream = fopen(path, "rb");
+    ownsStream = true;
+    return stream != nullptr;
+}
+
+void AsgCaptureReader::Close()
+{
+    Unmap();
+
+    if (stream != nullptr && ownsStream)
+        fclose(stream);
+    stream = nullptr;
+    ownsStream = false;
+
+    decoder.reset();
+
+    readPos = 0;
+    prefetchPos = 0;
+}
+
+bool AsgCaptureReader::IsOpen() const
+{
+    return mappedData != nullptr || stream != nullptr || decoder;
+}
+
+bool AsgCaptureReader::IsMapped() const
+{
+    return mappedData != nullptr;
+}
+
+const float* AsgCaptureReader::GetData() const
+{
+    return mappedData;
+}
+
+size_t AsgCaptureReader::GetSamplesNum() const
+{
+    return mappedSamplesNum;
+}
+
+const AsgCaptureFormat* AsgCaptureReader::GetFormat() const
+{
+    return decoder ? &decoder->GetFormat() : nullptr;
+}
+
+bool AsgCaptureReader::Seek(uint64_t sample)
+{
+    if (decoder)
+    {
+        const size_t channelsNum = decoder->GetFormat().channelsNum;
+        return sample % channelsNum == 0 && decoder->Seek(sample / channelsNum);
+    }
+
+    if (mappedData == nullptr || sample > mappedSamplesNum)
+        return false;
+
+    readPos = static_cast<size_t>(sample);
+    prefetchPos = readPos;
+    return true;
+}
+
+size_t AsgCaptureReader::Read(const float*& samples, size_t maxSamples)
+{
+    if (decoder)
+        return decoder->Read(samples, maxSamples);
+
+    if (mappedData != nullptr)
+    {
+        size_t samplesNum = std::min(maxSamples, mappedSamplesNum - readPos);
+        samples = mappedData + readPos;
+        readPos += samplesNum;
+
+        if (prefetchPos < readPos + PREFETCH_SAMPLES / 2 && prefetchPos < mappedSamplesNum)
+            Prefetch(std::min(readPos + PREFETCH_SAMPLES, mappedSamplesNum));
+        return samplesNum;
+    }
+
+    if (stream == nullptr)
+        return 0;
+
+    if (buffer.size() < maxSamples)
+        buffer.resize(maxSamples);
+
+    samples = buffer.data();
+    return fread(buffer.data(), sizeof(float), maxSamples, stream);
+}
+
+#ifdef _WIN32
+
+bool AsgCaptureReader::Map(const char* path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) ||
+        static_cast<unsigned long long>(size.QuadPart) > static_cast<size_t>(-1) ||
+        size.QuadPart < static_cast<LONGLONG>(sizeof(float)))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (data == nullptr)
+    {
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = static_cast<const float*>(data);
+    mappedSamplesNum = static_cast<size_t>(size.QuadPart) / sizeof(float);
+    return true;
+}
+
+void AsgCaptureReader::Unmap()
+{
+    if (mappedData != nullptr)
+        UnmapViewOfFile(mappedData);
+    if (mappingHandle != nullptr)
+        CloseHandle(mappingHandle);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+
+    mappedData = nullptr;
+    mappedSamplesNum = 0;
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+void AsgCaptureReader::Prefetch(size_t endSample)
+{
+    // the mapping was opened for a sequential scan, which reads ahead already
+    prefetchPos = endSample;
+}
+
+#else
+
+bool AsgCaptureReader::Map(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<unsigned long long>(st.st_size) > static_cast<size_t>(-1) ||
+        st.st_size < static_cast<off_t>(sizeof(float)))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t bytes = static_cast<size_t>(st.st_size);
+    void* data = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return false;
+    }
+
+    // the capture is scanned once from the beginning to the end, only a window ahead of the
+    // reading is requested (see Prefetch()) to keep the page cache use bounded
+    madvise(data, bytes, MADV_SEQUENTIAL);
+
+    fileDesc = fd;
+    mappedBytes = bytes;
+    mappedData = static_cast<const float*>(data);
+    mappedSamplesNum = bytes / sizeof(float);
+    return true;
+}
+
+void AsgCaptureReader::Unmap()
+{
+    if (mappedData != nullptr)
+        munmap(const_cast<float*>(mappedData), mappedBytes);
+    if (fileDesc >= 0)
+        close(fileDesc);
+
+    mappedData = nullptr;
+    mappedSamplesNum = 0;
+    mappedBytes = 0;
+    fileDesc = -1;
+}
+
+void AsgCaptureReader::Prefetch(size_t endSample)
+{
+    // from the page of the first sample not requested yet
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t begin = std::max(prefetchPos, readPos) * sizeof(float) / pageSize * pageSize;
+    const size_t end = endSample * sizeof(float);
+    if (end > begin)
+        madvise(const_cast<char*>(reinterpret_cast<const char*>(mappedData)) + begin, end - begin, MADV_WILLNEED);
+    prefetchPos = endSample;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "CompressedCapture.h"
+
+/**
+ * Source of samples from a raw capture file (32-bit float, little endian).
+ * Regular files are memory mapped and handed out as zero-copy spans of the mapping,
+ * pipes, stdin ("-") and files which can't be mapped are streamed through an internal buffer.
+ * Compressed captures (see AsgCaptureWriter) are decoded in parallel ahead of reading.
+ */
+class AsgCaptureReader
+{
+public:
+    static const size_t DEFAULT_SPAN_SAMPLES = 64 * 1024;
+
+private:
+    const float* mappedData;
+    size_t mappedSamplesNum;
+    size_t readPos;  // in samples, for mapped files
+    size_t prefetchPos;  // end of the read ahead requested for the mapping (in samples)
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDesc;
+    size_t mappedBytes;
+#endif
+
+    FILE* stream;
+    bool ownsStream;
+    std::vector<float> buffer;
+
+    size_t decodeThreadsNum;
+    std::unique_ptr<AsgCaptureDecoder> decoder;
+
+    bool Map(const char* path);
+    void Unmap();
+    void Prefetch(size_t endSample);
+
+public:
+    /**
+     * "decodeThreadsNum" threads decode compressed captures (0 - all cores).
+     */
+    explicit AsgCaptureReader(size_t decodeThreadsNum = 0);
+    ~AsgCaptureReader();
+    AsgCaptureReader(const AsgCaptureReader&) = delete;
+    AsgCaptureReader& operator=(const AsgCaptureReader&) = delete;
+
+    /**
+     * Open capture file. "-" stands for the standard input.
+     */
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const;
+
+    /**
+     * True if the file is memory mapped (and GetData() / GetSamplesNum() are valid).
+     */
+    bool IsMapped() const;
+
+    /**
+     * Whole mapped capture, nullptr if it's streamed.
+     */
+    const float* GetData() const;
+
+    /**
+     * Number of samples in the mapped capture, 0 if it's streamed.
+     */
+    size_t GetSamplesNum() const;
+
+    /**
+     * Format of a compressed capture, nullptr for raw ones.
+     */
+    const AsgCaptureFormat* GetFormat() const;
+
+    /**
+     * Continue reading from the given sample (mapped and compressed captures only).
+     */
+    bool Seek(uint64_t sample);
+
+    /**
+     * Get next span of at most maxSamples samples. The span is valid until the next call.
+     * Returns number of samples in the span (0 at the end of the capture).
+     */
+    size_t Read(const float*& samples, size_t maxSamples = DEFAULT_SPAN_SAMPLES);
+};
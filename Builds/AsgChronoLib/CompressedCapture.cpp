@@ -0,0 +1,807 @@
+#include "stdafx.h"
+#include "CompressedCapture.h"
+#include "ByteStream.h"
+#include "Trace.h"
+
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+const uint32_t CAPTURE_MAGIC = 0x43475341;  // "ASGC"
+const uint16_t CAPTURE_VERSION = 1;
+const size_t HEADER_SIZE = 36;
+const size_t SEEK_ENTRY_SIZE = 12;
+
+// limits of the format accepted by both the writer and the decoder, so the header of a damaged
+// file can't make the decoder allocate gigabytes of chunk buffers
+const size_t MAX_CHANNELS = 256;
+const size_t MAX_CHUNK_FRAMES = 1024 * 1024;
+const size_t MAX_CHUNK_SAMPLES = 4 * 1024 * 1024;
+
+const int MAX_ORDER = 4;
+const int ORDER_BITS = 3;
+const uint32_t MAX_RICE_PARAMETER = 30;
+const int RICE_PARAMETER_BITS = 5;
+const size_t PARTITION_SIZE = 512;  // samples sharing one Rice parameter
+
+const size_t BATCH_CHUNKS_PER_THREAD = 2;
+
+int CountLeadingZeros(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+        return 31 - static_cast<int>(index);
+    _BitScanReverse(&index, static_cast<unsigned long>(value));
+    return 63 - static_cast<int>(index);
+#else
+    return __builtin_clzll(value);
+#endif
+}
+
+// Bit stream ====
+
+/**
+ * Appends bits to a buffer, the most significant bit first.
+ */
+class BitWriter
+{
+    std::vector<uint8_t>& buffer;
+    uint64_t bits;
+    int bitsNum;
+
+public:
+    explicit BitWriter(std::vector<uint8_t>& buffer)
+        : buffer(buffer)
+        , bits(0)
+        , bitsNum(0)
+    {
+    }
+
+    // value must fit into n <= 32 bits
+    void Put(uint32_t value, int n)
+    {
+        bits = (bits << n) | value;
+        bitsNum += n;
+        while (bitsNum >= 8)
+        {
+            bitsNum -= 8;
+            buffer.push_back(static_cast<uint8_t>(bits >> bitsNum));
+        }
+    }
+
+    // q zeros followed by one
+    void PutUnary(uint32_t q)
+    {
+        for (; q >= 32; q -= 32)
+            Put(0, 32);
+        Put(1, q + 1);
+    }
+
+    void Flush()
+    {
+        if (bitsNum > 0)
+            Put(0, 8 - bitsNum);
+    }
+};
+
+/**
+ * Reads bits written by BitWriter, reads past the end return zeros and make IsOk() false.
+ */
+class BitReader
+{
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+    uint64_t window;  // left aligned, the bits below bitsNum are zero
+    int bitsNum;
+
+    void Refill()
+    {
+        while (bitsNum <= 56)
+        {
+            uint64_t byte = pos < size ? data[pos] : 0;
+            pos++;
+            window |= byte << (56 - bitsNum);
+            bitsNum += 8;
+        }
+    }
+
+public:
+    BitReader(const uint8_t* data, size_t size)
+        : data(data)
+        , size(size)
+        , pos(0)
+        , window(0)
+        , bitsNum(0)
+    {
+    }
+
+    uint32_t Get(int n)
+    {
+        if (n == 0)
+            return 0;
+
+        Refill();
+        uint32_t value = static_cast<uint32_t>(window >> (64 - n));
+        window <<= n;
+        bitsNum -= n;
+        return value;
+    }
+
+    uint32_t GetUnary()
+    {
+        uint32_t q = 0;
+        for (;;)
+        {
+            Refill();
+            if (window != 0)
+            {
+                int zeros = CountLeadingZeros(window);
+                window <<= zeros;
+                window <<= 1;
+                bitsNum -= zeros + 1;
+                return q + zeros;
+            }
+
+            q += bitsNum;
+            bitsNum = 0;
+            if (pos > size + sizeof(window))
+                return q;  // corrupted, IsOk() fails
+        }
+    }
+
+    bool IsOk() const
+    {
+        return pos * 8 - bitsNum <= size * 8;
+    }
+};
+
+// Prediction ====
+
+/**
+ * Fixed polynomial predictors (as in FLAC) - order n fits a polynomial of degree n - 1
+ * through the last n samples.
+ */
+inline int64_t Predict(int order, int64_t x1, int64_t x2, int64_t x3, int64_t x4)
+{
+    switch (order)
+    {
+    case 1: return x1;
+    case 2: return 2 * x1 - x2;
+    case 3: return 3 * x1 - 3 * x2 + x3;
+    case 4: return 4 * x1 - 6 * x2 + 4 * x3 - x4;
+    default: return 0;
+    }
+}
+
+// order with the smallest sum of absolute residuals
+int ChooseOrder(const int32_t* x, size_t n)
+{
+    if (n <= static_cast<size_t>(MAX_ORDER))
+        return 0;
+
+    uint64_t sums[MAX_ORDER + 1] = {};
+    for (size_t i = MAX_ORDER; i < n; ++i)
+    {
+        int64_t e0 = x[i];
+        int64_t e1 = e0 - x[i - 1];
+        int64_t e2 = e1 - (x[i - 1] - x[i - 2]);
+        int64_t e3 = e2 - (x[i - 1] - 2 * static_cast<int64_t>(x[i - 2]) + x[i - 3]);
+        int64_t e4 = e3 - (x[i - 1] - 3 * static_cast<int64_t>(x[i - 2]) + 3 * static_cast<int64_t>(x[i - 3]) - x[i - 4]);
+        sums[0] += e0 < 0 ? -e0 : e0;
+        sums[1] += e1 < 0 ? -e1 : e1;
+        sums[2] += e2 < 0 ? -e2 : e2;
+        sums[3] += e3 < 0 ? -e3 : e3;
+        sums[4] += e4 < 0 ? -e4 : e4;
+    }
+
+    int order = 0;
+    for (int i = 1; i <= MAX_ORDER; ++i)
+    {
+        if (sums[i] < sums[order])
+            order = i;
+    }
+    return order;
+}
+
+uint64_t RiceCost(const uint32_t* values, size_t n, uint32_t k)
+{
+    uint64_t cost = n * (k + 1);
+    for (size_t i = 0; i < n; ++i)
+        cost += values[i] >> k;
+    return cost;
+}
+
+uint32_t ChooseRiceParameter(const uint32_t* values, size_t n)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i)
+        sum += values[i];
+
+    // estimate from the mean, then refine with the exact cost of the neighbours
+    uint32_t estimate = 0;
+    while (estimate < MAX_RICE_PARAMETER && (static_cast<uint64_t>(n) << (estimate + 1)) < sum)
+        estimate++;
+
+    uint32_t best = estimate;
+    uint64_t bestCost = RiceCost(values, n, estimate);
+    for (uint32_t k = estimate > 0 ? estimate - 1 : 0; k <= std::min(estimate + 1, MAX_RICE_PARAMETER); ++k)
+    {
+        uint64_t cost = RiceCost(values, n, k);
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            best = k;
+        }
+    }
+    return best;
+}
+
+// Chunk coding ====
+
+void EncodeChannel(const int32_t* x, size_t n, int bitsPerSample, std::vector<uint32_t>& residuals,
+                   BitWriter& writer)
+{
+    const int order = ChooseOrder(x, n);
+    writer.Put(order, ORDER_BITS);
+
+    const uint32_t sampleMask = (1u << bitsPerSample) - 1;
+    for (int i = 0; i < order; ++i)
+        writer.Put(static_cast<uint32_t>(x[i]) & sampleMask, bitsPerSample);
+
+    residuals.resize(n);
+    for (size_t i = order; i < n; ++i)
+    {
+        int64_t residual = x[i];
+        if (order > 0)
+            residual -= Predict(order, x[i - 1], i >= 2 ? x[i - 2] : 0, i >= 3 ? x[i - 3] : 0, i >= 4 ? x[i - 4] : 0);
+        residuals[i] = static_cast<uint32_t>((static_cast<uint64_t>(residual) << 1) ^ static_cast<uint64_t>(residual >> 63));
+    }
+
+    for (size_t begin = 0; begin < n; begin += PARTITION_SIZE)
+    {
+        size_t first = std::max<size_t>(begin, order);
+        size_t end = std::min(begin + PARTITION_SIZE, n);
+        if (first >= end)
+            continue;
+
+        const uint32_t k = ChooseRiceParameter(&residuals[first], end - first);
+        writer.Put(k, RICE_PARAMETER_BITS);
+        for (size_t i = first; i < end; ++i)
+        {
+            writer.PutUnary(residuals[i] >> k);
+            writer.Put(residuals[i] & ((1u << k) - 1), k);
+        }
+    }
+}
+
+/**
+ * Encode framesNum interleaved frames. Returns number of samples not stored exactly.
+ */
+uint64_t EncodeChunk(const float* samples, size_t framesNum, const AsgCaptureFormat& format,
+                     std::vector<uint8_t>& encoded)
+{
+    const double scale = static_cast<double>(1 << (format.bitsPerSample - 1));
+    const double minValue = -scale;
+    const double maxValue = scale - 1.0;
+
+    std::vector<int32_t> x(framesNum);
+    std::vector<uint32_t> residuals;
+    uint64_t inexactNum = 0;
+
+    encoded.clear();
+    BitWriter writer(encoded);
+    for (size_t channel = 0; channel < format.channelsNum; ++channel)
+    {
+        for (size_t i = 0; i < framesNum; ++i)
+        {
+            double value = samples[i * format.channelsNum + channel] * scale;
+            double rounded = std::min(std::max(floor(value + 0.5), minValue), maxValue);
+            if (rounded != value)
+                inexactNum++;
+            x[i] = static_cast<int32_t>(rounded);
+        }
+
+        EncodeChannel(x.data(), framesNum, format.bitsPerSample, residuals, writer);
+    }
+
+    writer.Flush();
+    return inexactNum;
+}
+
+bool DecodeChunk(const uint8_t* data, size_t size, size_t framesNum, const AsgCaptureFormat& format, float* samples)
+{
+    const int bitsPerSample = format.bitsPerSample;
+    const float invScale = 1.0f / static_cast<float>(1 << (bitsPerSample - 1));
+    const size_t stride = format.channelsNum;
+
+    BitReader reader(data, size);
+    for (size_t channel = 0; channel < format.channelsNum; ++channel)
+    {
+        float* out = samples + channel;
+        const int order = static_cast<int>(reader.Get(ORDER_BITS));
+        if (order > MAX_ORDER || static_cast<size_t>(order) > framesNum)
+            return false;
+
+        int64_t x1 = 0, x2 = 0, x3 = 0, x4 = 0;
+        for (int i = 0; i < order; ++i)
+        {
+            // sign extension
+            int64_t x = static_cast<int32_t>(reader.Get(bitsPerSample) << (32 - bitsPerSample)) >> (32 - bitsPerSample);
+            out[i * stride] = static_cast<float>(x) * invScale;
+            x4 = x3;
+            x3 = x2;
+            x2 = x1;
+            x1 = x;
+        }
+
+        for (size_t begin = 0; begin < framesNum; begin += PARTITION_SIZE)
+        {
+            size_t first = std::max<size_t>(begin, order);
+            size_t end = std::min(begin + PARTITION_SIZE, framesNum);
+            if (first >= end)
+                continue;
+
+            const uint32_t k = reader.Get(RICE_PARAMETER_BITS);
+            if (k > MAX_RICE_PARAMETER)
+                return false;
+
+            for (size_t i = first; i < end; ++i)
+            {
+                uint64_t u = (static_cast<uint64_t>(reader.GetUnary()) << k) | reader.Get(k);
+                int64_t x = Predict(order, x1, x2, x3, x4) + (static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1));
+                out[i * stride] = static_cast<float>(x) * invScale;
+                x4 = x3;
+                x3 = x2;
+                x2 = x1;
+                x1 = x;
+            }
+        }
+    }
+
+    return reader.IsOk();
+}
+
+void EncodeHeader(std::vector<uint8_t>& header, const AsgCaptureFormat& format, uint64_t seekTableOffset)
+{
+    header.clear();
+    AsgPutU32(header, CAPTURE_MAGIC);
+    AsgPutU16(header, CAPTURE_VERSION);
+    AsgPutU16(header, static_cast<uint16_t>(HEADER_SIZE));
+    AsgPutU16(header, static_cast<uint16_t>(format.channelsNum));
+    AsgPutU8(header, static_cast<uint8_t>(format.bitsPerSample));
+    AsgPutU8(header, 0);
+    AsgPutFloat(header, format.sampleRate);
+    AsgPutU32(header, static_cast<uint32_t>(format.chunkFrames));
+    AsgPutU64(header, format.framesNum);
+    AsgPutU64(header, seekTableOffset);
+}
+
+size_t GetBatchChunks(const AsgWorkerPool& workerPool)
+{
+    return BATCH_CHUNKS_PER_THREAD * workerPool.GetThreadsNum();
+}
+
+} // namespace
+
+// AsgCaptureWriter ====
+
+AsgCaptureWriter::AsgCaptureWriter(size_t threadsNum)
+    : file(nullptr)
+    , workerPool(new AsgWorkerPool(threadsNum))
+    , offset(0)
+    , inexactNum(0)
+    , failed(false)
+{
+    batchChunks = GetBatchChunks(*workerPool);
+    format = AsgCaptureFormat();
+}
+
+AsgCaptureWriter::~AsgCaptureWriter()
+{
+    Close();
+}
+
+bool AsgCaptureWriter::Open(const char* path, size_t channelsNum, float sampleRate, int bitsPerSample,
+                            size_t chunkFrames)
+{
+    Close();
+
+    if (channelsNum == 0 || channelsNum > MAX_CHANNELS || (bitsPerSample != 16 && bitsPerSample != 24) ||
+        chunkFrames == 0 || chunkFrames > MAX_CHUNK_FRAMES || chunkFrames * channelsNum > MAX_CHUNK_SAMPLES)
+        return false;
+
+    file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    format.channelsNum = channelsNum;
+    format.sampleRate = sampleRate;
+    format.bitsPerSample = bitsPerSample;
+    format.chunkFrames = chunkFrames;
+    format.framesNum = 0;
+
+    pending.clear();
+    seekTable.clear();
+    inexactNum = 0;
+    failed = false;
+
+    // completed in Close()
+    std::vector<uint8_t> header;
+    EncodeHeader(header, format, 0);
+    offset = header.size();
+    failed = fwrite(header.data(), 1, header.size(), file) != header.size();
+    return !failed;
+}
+
+bool AsgCaptureWriter::Write(const float* samples, size_t framesNum)
+{
+    if (file == nullptr || failed)
+        return false;
+
+    pending.insert(pending.end(), samples, samples + framesNum * format.channelsNum);
+    format.framesNum += framesNum;
+
+    const size_t batchFrames = batchChunks * format.chunkFrames;
+    while (pending.size() >= batchFrames * format.channelsNum && !failed)
+        EncodePending(batchFrames);
+
+    return !failed;
+}
+
+void AsgCaptureWriter::EncodePending(size_t framesNum)
+{
+    const size_t chunkFrames = format.chunkFrames;
+    const size_t chunksNum = (framesNum + chunkFrames - 1) / chunkFrames;
+    if (encoded.size() < chunksNum)
+        encoded.resize(chunksNum);
+    inexactNums.resize(chunksNum);
+
+    workerPool->ParallelFor(chunksNum, [&](size_t i)
+    {
+        size_t chunkSize = std::min(chunkFrames, framesNum - i * chunkFrames);
+        inexactNums[i] = EncodeChunk(&pending[i * chunkFrames * format.channelsNum], chunkSize, format, encoded[i]);
+    });
+
+    for (size_t i = 0; i < chunksNum && !failed; ++i)
+    {
+        SeekEntry entry;
+        entry.offset = offset;
+        entry.size = static_cast<uint32_t>(encoded[i].size());
+        seekTable.push_back(entry);
+
+        failed = fwrite(encoded[i].data(), 1, encoded[i].size(), file) != encoded[i].size();
+        offset += encoded[i].size();
+        inexactNum += inexactNums[i];
+    }
+
+    pending.erase(pending.begin(), pending.begin() + framesNum * format.channelsNum);
+}
+
+bool AsgCaptureWriter::Close()
+{
+    if (file == nullptr)
+        return false;
+
+    if (!pending.empty() && !failed)
+        EncodePending(pending.size() / format.channelsNum);
+
+    std::vector<uint8_t> buffer;
+    for (size_t i = 0; i < seekTable.size(); ++i)
+    {
+        AsgPutU64(buffer, seekTable[i].offset);
+        AsgPutU32(buffer, seekTable[i].size);
+    }
+
+    const uint64_t seekTableOffset = offset;
+    if (!failed)
+        failed = fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size();
+    offset += buffer.size();
+
+    EncodeHeader(buffer, format, seekTableOffset);
+    if (!failed)
+        failed = !AsgSeekFile(file, 0) || fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size();
+
+    if (fclose(file) != 0)
+        failed = true;
+    file = nullptr;
+    pending.clear();
+    return !failed;
+}
+
+uint64_t AsgCaptureWriter::GetInexactNum() const
+{
+    return inexactNum;
+}
+
+uint64_t AsgCaptureWriter::GetBytesNum() const
+{
+    return offset;
+}
+
+// AsgCaptureDecoder ====
+
+AsgCaptureDecoder::AsgCaptureDecoder(size_t threadsNum)
+    : file(nullptr)
+    , workerPool(new AsgWorkerPool(threadsNum))
+    , nextChunk(0)
+    , quit(false)
+    , failed(false)
+    , current(nullptr)
+    , currentBatch(0)
+    , readPos(0)
+    , skipSamples(0)
+{
+    batchChunks = GetBatchChunks(*workerPool);
+    format = AsgCaptureFormat();
+}
+
+AsgCaptureDecoder::~AsgCaptureDecoder()
+{
+    Close();
+}
+
+bool AsgCaptureDecoder::IsCompressed(const char* path)
+{
+    FILE* probe = fopen(path, "rb");
+    if (probe == nullptr)
+        return false;
+
+    uint8_t magic[4];
+    bool compressed = fread(magic, 1, sizeof(magic), probe) == sizeof(magic) &&
+                      AsgByteReader(magic, sizeof(magic)).GetU32() == CAPTURE_MAGIC;
+    fclose(probe);
+    return compressed;
+}
+
+bool AsgCaptureDecoder::Open(const char* path)
+{
+    Close();
+
+    file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    const uint64_t fileSize = AsgGetFileSize(file);
+
+    std::vector<uint8_t> buffer;
+    if (!AsgReadBytes(file, 0, HEADER_SIZE, buffer))
+    {
+        Close();
+        return false;
+    }
+
+    AsgByteReader header(buffer.data(), buffer.size());
+    const uint32_t magic = header.GetU32();
+    const uint16_t version = header.GetU16();
+    header.GetU16();  // header size, only one version so far
+    format.channelsNum = header.GetU16();
+    format.bitsPerSample = header.GetU8();
+    header.GetU8();
+    format.sampleRate = header.GetFloat();
+    format.chunkFrames = header.GetU32();
+    format.framesNum = header.GetU64();
+    const uint64_t seekTableOffset = header.GetU64();
+
+    if (magic != CAPTURE_MAGIC || version > CAPTURE_VERSION ||
+        format.channelsNum == 0 || format.channelsNum > MAX_CHANNELS ||
+        (format.bitsPerSample != 16 && format.bitsPerSample != 24) ||
+        format.chunkFrames == 0 || format.chunkFrames > MAX_CHUNK_FRAMES ||
+        format.chunkFrames * format.channelsNum > MAX_CHUNK_SAMPLES ||
+        seekTableOffset < HEADER_SIZE || seekTableOffset > fileSize)
+    {
+        Close();
+        return false;
+    }
+
+    // the seek table must fit between the header and the end of the file, checked before the
+    // multiplication can overflow
+    const uint64_t chunksNum = format.framesNum / format.chunkFrames + (format.framesNum % format.chunkFrames != 0 ? 1 : 0);
+    if (chunksNum > (fileSize - HEADER_SIZE) / SEEK_ENTRY_SIZE ||
+        seekTableOffset + chunksNum * SEEK_ENTRY_SIZE > fileSize ||
+        !AsgReadBytes(file, seekTableOffset, static_cast<size_t>(chunksNum * SEEK_ENTRY_SIZE), buffer))
+    {
+        Close();
+        return false;
+    }
+
+    // chunks are stored one after another
+    AsgByteReader table(buffer.data(), buffer.size());
+    uint64_t expectedOffset = HEADER_SIZE;
+    seekTable.resize(static_cast<size_t>(chunksNum));
+    for (size_t i = 0; i < seekTable.size(); ++i)
+    {
+        seekTable[i].offset = table.GetU64();
+        seekTable[i].size = table.GetU32();
+        if (seekTable[i].offset != expectedOffset)
+        {
+            Close();
+            return false;
+        }
+        expectedOffset += seekTable[i].size;
+    }
+    if (expectedOffset > seekTableOffset)
+    {
+        Close();
+        return false;
+    }
+
+    for (Batch& batch : batches)
+        batch.samples.resize(batchChunks * format.chunkFrames * format.channelsNum);
+
+    skipSamples = 0;
+    Start(0);
+    return true;
+}
+
+void AsgCaptureDecoder::Close()
+{
+    Stop();
+
+    if (file != nullptr)
+        fclose(file);
+    file = nullptr;
+
+    format = AsgCaptureFormat();
+    seekTable.clear();
+    current = nullptr;
+}
+
+const AsgCaptureFormat& AsgCaptureDecoder::GetFormat() const
+{
+    return format;
+}
+
+void AsgCaptureDecoder::Start(size_t firstChunk)
+{
+    for (Batch& batch : batches)
+    {
+        batch.samplesNum = 0;
+        batch.ready = false;
+    }
+
+    nextChunk = firstChunk;
+    quit = false;
+    failed = false;
+    current = nullptr;
+    currentBatch = 0;
+    readPos = 0;
+    thread = std::thread(&AsgCaptureDecoder::DecoderMain, this);
+}
+
+void AsgCaptureDecoder::Stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    batchCondition.notify_all();
+    thread.join();
+}
+
+void AsgCaptureDecoder::DecoderMain()
+{
+    ASG_TRACE_THREAD_NAME("Decoder");
+    for (size_t i = 0;; i ^= 1)
+    {
+        Batch& batch = batches[i];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            batchCondition.wait(guard, [&] { return quit || !batch.ready; });
+            if (quit)
+                return;
+        }
+
+        const size_t chunksNum = std::min(batchChunks, seekTable.size() - nextChunk);
+        batch.samplesNum = 0;
+        const bool ok = chunksNum == 0 || DecodeBatch(batch, nextChunk, chunksNum);
+        nextChunk += chunksNum;
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!ok)
+            {
+                failed = true;
+                batch.samplesNum = 0;
+            }
+            batch.ready = true;
+        }
+        batchCondition.notify_all();
+
+        // an empty batch marks the end
+        if (batch.samplesNum == 0)
+            return;
+    }
+}
+
+bool AsgCaptureDecoder::DecodeBatch(Batch& batch, size_t firstChunk, size_t chunksNum)
+{
+    ASG_TRACE_SCOPE("DecodeBatch");
+    const SeekEntry& last = seekTable[firstChunk + chunksNum - 1];
+    const uint64_t base = seekTable[firstChunk].offset;
+    if (!AsgReadBytes(file, base, static_cast<size_t>(last.offset + last.size - base), batch.data))
+        return false;
+
+    const size_t chunkSamples = format.chunkFrames * format.channelsNum;
+    std::atomic<bool> ok(true);
+    workerPool->ParallelFor(chunksNum, [&](size_t i)
+    {
+        const size_t chunk = firstChunk + i;
+        const SeekEntry& entry = seekTable[chunk];
+        const uint64_t framesNum = std::min<uint64_t>(format.chunkFrames, format.framesNum - chunk * format.chunkFrames);
+        if (!DecodeChunk(&batch.data[static_cast<size_t>(entry.offset - base)], entry.size,
+                         static_cast<size_t>(framesNum), format, &batch.samples[i * chunkSamples]))
+            ok = false;
+    });
+
+    const uint64_t lastFrame = std::min<uint64_t>((firstChunk + chunksNum) * format.chunkFrames, format.framesNum);
+    batch.samplesNum = static_cast<size_t>(lastFrame - firstChunk * format.chunkFrames) * format.channelsNum;
+    return ok;
+}
+
+size_t AsgCaptureDecoder::Read(const float*& samples, size_t maxSamples)
+{
+    if (file == nullptr)
+        return 0;
+
+    while (current == nullptr || readPos == current->samplesNum)
+    {
+        if (current != nullptr)
+        {
+            if (current->samplesNum == 0)
+                return 0;
+
+            // hand the batch back to the decoder thread
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                current->ready = false;
+            }
+            batchCondition.notify_all();
+            currentBatch ^= 1;
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            batchCondition.wait(guard, [&] { return batches[currentBatch].ready; });
+        }
+
+        current = &batches[currentBatch];
+        readPos = std::min(skipSamples, current->samplesNum);
+        skipSamples = 0;
+    }
+
+    const size_t samplesNum = std::min(maxSamples, current->samplesNum - readPos);
+    samples = current->samples.data() + readPos;
+    readPos += samplesNum;
+    return samplesNum;
+}
+
+bool AsgCaptureDecoder::Seek(uint64_t frame)
+{
+    if (file == nullptr || frame > format.framesNum)
+        return false;
+
+    Stop();
+    const uint64_t chunk = frame / format.chunkFrames;
+    skipSamples = static_cast<size_t>(frame - chunk * format.chunkFrames) * format.channelsNum;
+    Start(static_cast<size_t>(chunk));
+    return true;
+}
+
+bool AsgCaptureDecoder::HasFailed()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return failed;
+}
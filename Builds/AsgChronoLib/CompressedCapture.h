@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdint>
+
+#include "WorkerPool.h"
+
+/*
+ * Compressed capture - chunked lossless compression of integer samples (all values little endian):
+ *
+ *   header:      "ASGC", uint16 version, uint16 header size, uint16 channels, uint8 bits per sample,
+ *                uint8 reserved, float sample rate, uint32 frames per chunk, uint64 frames,
+ *                uint64 seek table offset
+ *   chunks:      per channel the order of the fixed linear predictor (0-4), the warm-up samples and
+ *                Rice coded prediction residuals in partitions with their own Rice parameter
+ *   seek table:  per chunk uint64 offset and uint32 size
+ *
+ * Samples are stored as 16 or 24-bit integers, floats are scaled by 2^(bits - 1), so captures
+ * recorded by 16 or 24-bit sound cards are stored without any loss. Chunks are independent,
+ * they are encoded and decoded in parallel.
+ */
+
+struct AsgCaptureFormat
+{
+    size_t channelsNum;
+    float sampleRate;
+    int bitsPerSample;  // 16 or 24
+    size_t chunkFrames;
+    uint64_t framesNum;
+};
+
+/**
+ * Writes a compressed capture (the file must be seekable, the header is completed in Close()).
+ */
+class AsgCaptureWriter
+{
+public:
+    static const size_t DEFAULT_CHUNK_FRAMES = 4096;
+
+private:
+    struct SeekEntry
+    {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    FILE* file;
+    AsgCaptureFormat format;
+    std::unique_ptr<AsgWorkerPool> workerPool;
+    size_t batchChunks;  // chunks encoded in parallel
+
+    std::vector<float> pending;  // interleaved samples not encoded yet
+    std::vector<std::vector<uint8_t>> encoded;
+    std::vector<uint64_t> inexactNums;
+    std::vector<SeekEntry> seekTable;
+    uint64_t offset;
+    uint64_t inexactNum;
+    bool failed;
+
+    void EncodePending(size_t framesNum);
+
+public:
+    /**
+     * Create writer using "threadsNum" threads for encoding (0 - all cores).
+     */
+    explicit AsgCaptureWriter(size_t threadsNum = 0);
+    ~AsgCaptureWriter();
+    AsgCaptureWriter(const AsgCaptureWriter&) = delete;
+    AsgCaptureWriter& operator=(const AsgCaptureWriter&) = delete;
+
+    bool Open(const char* path, size_t channelsNum, float sampleRate, int bitsPerSample = 16,
+              size_t chunkFrames = DEFAULT_CHUNK_FRAMES);
+
+    /**
+     * Append interleaved frames.
+     */
+    bool Write(const float* samples, size_t framesNum);
+
+    /**
+     * Encode the rest of the samples, write the seek table and complete the header.
+     */
+    bool Close();
+
+    /**
+     * Number of samples which couldn't be stored exactly (not on the integer grid or clipped).
+     */
+    uint64_t GetInexactNum() const;
+
+    /**
+     * Size of the file written so far.
+     */
+    uint64_t GetBytesNum() const;
+};
+
+/**
+ * Reads a compressed capture. A background thread decodes batches of chunks in parallel ahead of
+ * the caller, so the detector never waits for decoding when there are enough cores.
+ */
+class AsgCaptureDecoder
+{
+    struct SeekEntry
+    {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    struct Batch
+    {
+        std::vector<uint8_t> data;
+        std::vector<float> samples;
+        size_t samplesNum;  // 0 - end of the capture
+        bool ready;
+    };
+
+    FILE* file;
+    AsgCaptureFormat format;
+    std::vector<SeekEntry> seekTable;
+    std::unique_ptr<AsgWorkerPool> workerPool;
+    size_t batchChunks;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable batchCondition;
+    Batch batches[2];
+    size_t nextChunk;  // next chunk to decode
+    bool quit;
+    bool failed;
+
+    // reading thread
+    Batch* current;
+    size_t currentBatch;
+    size_t readPos;
+    size_t skipSamples;  // from the beginning of the next batch, after Seek()
+
+    void DecoderMain();
+    bool DecodeBatch(Batch& batch, size_t firstChunk, size_t chunksNum);
+    void Start(size_t firstChunk);
+    void Stop();
+
+public:
+    /**
+     * Create decoder using "threadsNum" threads for decoding (0 - all cores).
+     */
+    explicit AsgCaptureDecoder(size_t threadsNum = 0);
+    ~AsgCaptureDecoder();
+    AsgCaptureDecoder(const AsgCaptureDecoder&) = delete;
+    AsgCaptureDecoder& operator=(const AsgCaptureDecoder&) = delete;
+
+    /**
+     * Check whether the file starts with the compressed capture signature.
+     */
+    static bool IsCompressed(const char* path);
+
+    bool Open(const char* path);
+    void Close();
+
+    const AsgCaptureFormat& GetFormat() const;
+
+    /**
+     * Get next span of at most maxSamples interleaved samples. The span is valid until the next call.
+     * Returns number of samples in the span (0 at the end of the capture or if it's corrupted).
+     */
+    size_t Read(const float*& samples, size_t maxSamples);
+
+    /**
+     * Continue reading from the given frame.
+     */
+    bool Seek(uint64_t frame);
+
+    /**
+     * True if a chunk couldn't be read or decoded.
+     */
+    bool HasFailed();
+};
@@ -1,8 +1,19 @@
 #include "stdafx.h"
 #include "Counter.h"
+#include "Simd.h"
+#include "Trace.h"
 
-// for Hermite interpolation
-const size_t HISTORY_SAMPLES_BEFORE = 2;
+const size_t AsgCounter::MIN_BLOCK_SIZE;
+const size_t AsgCounter::HISTORY_SAMPLES_BEFORE;
+const size_t AsgCounter::MIN_COARSE_PULSE;
+
+const float TRESHOLD_OFFSET = 0.001f;  // minimum treshold
+
+// with sliding noise floor, the treshold is kept above this fraction of the recent peaks amplitude
+const float PEAK_HOLD_RATIO = 0.2f;
+const float PEAK_HOLD_HALF_LIFE = 1024.0f;  // in samples
+
+const float AUTO_DECIMATION_RATE = 48000.0f;  // sample rate of the decimated signal in auto mode
 
 AsgCounterConfig::AsgCounterConfig()
 {
@@ -15,6 +26,29 @@ AsgCounterConfig::AsgCounterConfig()
     mass = 0.0002f;
     fireRateTreshold = 1.25f;
     detectionSigma = 7.0f;
+
+    blockSize = 8192;
+    rmsWindow = 0;
+    noiseEstimator = AsgNoiseEstimator::Rms;
+    decimation = 0;
+
+    peakEstimator = AsgPeakEstimator::Hermite;
+
+    highPassFrequency = 0.0f;
+    humFrequency = 0.0f;
+    lowPassFrequency = 0.0f;
+
+    historySize = 0;
+}
+
+
+uint64_t AsgStatsSummary::CountShotsAboveEnergy(float energy, float mass) const
+{
+    if (mass <= 0.0f)
+        return 0;
+
+    // E = m * v^2 / 2
+    return velocitySketch.CountAbove(sqrtf(2.0f * energy / mass));
 }
 
 
@@ -25,143 +59,305 @@ AsgStats::AsgStats()
 
 void AsgStats::Reset()
 {
-    history.clear();
+    Reset(history.GetCapacity());
+}
+
+void AsgStats::Reset(size_t historySize)
+{
+    history.Reset(historySize);
+    shotsNum = 0;
+
+    velocityMin = FLT_MAX;
+    velocityMax = FLT_MIN;
+    velocityAvg = -1.0f;
+    velocityStdDev = -1.0f;
+
     fireRateMin = -1.0f;
     fireRateMax = -1.0f;
     fireRateAvg = -1.0f;
     fireRateStdDev = -1.0f;
+
+    velocitySamplesNum = 0;
+    velocityMean = 0.0;
+    velocityM2 = 0.0;
+    velocitySketch.Reset();
+    fireRateSketch.Reset();
+
+    burstSamples = 0;
+    burstSum = 0.0f;
+    burstMin = 0.0f;
+    burstMax = 0.0f;
+    burstSemiAuto = false;
 }
 
 void AsgStats::Print() const
 {
-    printf("Stats (based on %i samples):\n", (int)history.size());
+    printf("Stats (based on %i samples):\n", (int)shotsNum);
     printf("Velocity:  avg = %.1f, min = %.1f, max = %.1f, std. dev. = %.2f\n",
            velocityAvg, velocityMin, velocityMax, velocityStdDev);
+    const float fractions[] = { 0.5f, 0.95f, 0.99f };
+    float percentiles[3];
+    if (velocitySamplesNum > 0)
+    {
+        velocitySketch.GetQuantiles(fractions, percentiles, 3);
+        printf("Velocity:  p50 = %.1f, p95 = %.1f, p99 = %.1f\n", percentiles[0], percentiles[1], percentiles[2]);
+    }
     printf("Fire rate: avg = %.2f, min = %.2f, max = %.2f, std. dev. = %.2f\n",
            fireRateAvg, fireRateMin, fireRateMax, fireRateStdDev);
+    if (fireRateSketch.GetCount() > 0)
+    {
+        fireRateSketch.GetQuantiles(fractions, percentiles, 3);
+        printf("Fire rate: p50 = %.2f, p95 = %.2f, p99 = %.2f\n", percentiles[0], percentiles[1], percentiles[2]);
+    }
 }
 
-void AsgStats::Calc(const AsgCounterConfig& cfg)
+void AsgStats::UpdateVelocity(float velocity)
 {
-    velocityMin = FLT_MAX;
-    velocityMax = FLT_MIN;
-    velocityAvg = -1.0f;
-    velocityStdDev = -1.0f;
+    if (velocity <= 0.0f)
+        return;
 
-    int validVelocitySamples = 0;
-    float sum = 0.0f;
+    // Welford's online algorithm
+    velocitySamplesNum++;
+    double delta = velocity - velocityMean;
+    velocityMean += delta / static_cast<double>(velocitySamplesNum);
+    velocityM2 += delta * (velocity - velocityMean);
+    velocitySketch.Add(velocity);
 
-    // calculate average velocity
-    for (size_t i = 0; i < history.size(); ++i)
-    {
-        if (history[i].velocity > 0.0f)
-        {
-            sum += history[i].velocity;
-            if (history[i].velocity > velocityMax)
-                velocityMax = history[i].velocity;
-            if (history[i].velocity < velocityMin)
-                velocityMin = history[i].velocity;
-            validVelocitySamples++;
-        }
-    }
+    if (velocity > velocityMax)
+        velocityMax = velocity;
+    if (velocity < velocityMin)
+        velocityMin = velocity;
 
-    if (validVelocitySamples > 0)
-    {
-        velocityAvg = sum / (float)validVelocitySamples;
-        float stdDevSum = 0.0f;
+    velocityAvg = static_cast<float>(velocityMean);
+    velocityStdDev = static_cast<float>(sqrt(velocityM2 / static_cast<double>(velocitySamplesNum)));
+}
 
-        // calculate standard deviation
-        for (size_t i = 0; i < history.size(); ++i)
-        {
-            if (history[i].velocity > 0.0f)
-            {
-                float difference = velocityAvg - history[i].velocity;
-                stdDevSum += difference * difference;
-            }
-        }
+void AsgStats::UpdateFireRate(float dt, float fireRateTreshold)
+{
+    if (dt <= 0.0f)
+        return;
 
-        velocityStdDev = sqrtf(stdDevSum / (float)validVelocitySamples);
+    // The burst is the longest run of the recent shots with intervals similar to the last one.
+    if (burstSamples > 0 && burstMax <= dt * fireRateTreshold && burstMin * fireRateTreshold >= dt)
+    {
+        burstSamples++;
+        burstSum += dt;
+        burstMin = std::min(burstMin, dt);
+        burstMax = std::max(burstMax, dt);
     }
-
-    // calculate fire rate stats
-    if (history.size() > 2)
+    else
     {
-        float lastDeltaTime = history[history.size() - 1].deltaTime;
-        float minDeltaTime = lastDeltaTime;
-        float maxDeltaTime = lastDeltaTime;
-        float deltaTimeSum = lastDeltaTime;
-        int samples = 1;
-
-        for (size_t i = history.size() - 2; i > 0; --i)
-        {
-            float dt = history[i].deltaTime;
-
-            if (dt > lastDeltaTime * cfg.fireRateTreshold)
-            {
-                break;
-            }
-
-            // we are in semi-auto mode - do not calculate RoF
-            if (dt * cfg.fireRateTreshold < lastDeltaTime)
-            {
-                samples = 0;
-                break;
-            }
-
-            // TODO: support for minimum fire rate (config)
+        // the last interval is much longer than some of the previous ones -
+        // we are in semi-auto mode, do not calculate RoF until the next faster burst
+        if (burstSamples > 0 && burstMin * fireRateTreshold < dt)
+            burstSemiAuto = true;
+        else if (burstSamples > 0)
+            burstSemiAuto = false;
+
+        burstSamples = 1;
+        burstSum = dt;
+        burstMin = dt;
+        burstMax = dt;
+    }
 
-            if (dt > maxDeltaTime)
-                maxDeltaTime = dt;
-            if (dt < minDeltaTime)
-                minDeltaTime = dt;
-            deltaTimeSum += dt;
-            samples++;
-        }
+    // TODO: support for minimum fire rate (config)
 
-        if (samples > 0)
-        {
-            fireRateMin = 1.0f / maxDeltaTime;
-            fireRateMax = 1.0f / minDeltaTime;
-            fireRateAvg = (float)samples / deltaTimeSum;
-        }
-        else
-        {
-            fireRateMin = -1.0f;
-            fireRateMax = -1.0f;
-            fireRateAvg = -1.0f;
-            fireRateStdDev = -1.0f;
-        }
+    if (shotsNum > 2 && !burstSemiAuto)
+    {
+        fireRateMin = 1.0f / burstMax;
+        fireRateMax = 1.0f / burstMin;
+        fireRateAvg = static_cast<float>(burstSamples) / burstSum;
+        fireRateSketch.Add(1.0f / dt);
+    }
+    else if (shotsNum > 2)
+    {
+        fireRateMin = -1.0f;
+        fireRateMax = -1.0f;
+        fireRateAvg = -1.0f;
+        fireRateStdDev = -1.0f;
     }
 }
 
-void AsgStats::AddSample(float velocity, float deltaTime)
+void AsgStats::AddSample(float velocity, float deltaTime, double position, const AsgCounterConfig& cfg)
 {
     AsgStatsSample sample;
     sample.velocity = velocity;
     sample.deltaTime = deltaTime;
-    history.push_back(sample);
+    sample.position = position;
+    history.Add(sample);
+    AddSummarySample(velocity, deltaTime, cfg);
+}
+
+void AsgStats::AddSummarySample(float velocity, float deltaTime, const AsgCounterConfig& cfg)
+{
+    shotsNum++;
+    UpdateVelocity(velocity);
+    UpdateFireRate(deltaTime, cfg.fireRateTreshold);
+}
+
+AsgStatsSummary AsgStats::GetSummary(size_t shotsNum, const AsgCounterConfig& cfg) const
+{
+    // replay the shots, so the window statistics are calculated the same way as the session ones
+    AsgStats window;
+    size_t first = history.GetSize() - std::min(shotsNum, history.GetSize());
+    for (size_t i = first; i < history.GetSize(); ++i)
+    {
+        const AsgStatsSample& sample = history[i];
+        window.AddSummarySample(sample.velocity, i > first ? sample.deltaTime : -1.0f, cfg);
+    }
+
+    return window;
+}
+
+size_t AsgStats::CountShotsSincePause(float pause) const
+{
+    size_t shotsNum = 0;
+    while (shotsNum < history.GetSize())
+    {
+        float dt = history[history.GetSize() - 1 - shotsNum].deltaTime;
+        shotsNum++;
+        if (dt < 0.0f || dt > pause)
+            break;
+    }
+    return shotsNum;
 }
 
 AsgCounter::AsgCounter()
+    : configPending(false)
 {
-    buffer.resize(BUFFER_SIZE);
     Reset();
 }
 
 void AsgCounter::Reset()
 {
+    Reset(0);
+}
+
+void AsgCounter::Reset(uint64_t samplePos)
+{
+    // the config assigned through GetConfig() is newer than the pending one
+    configPending = false;
+
+    SetupDetection(samplePos);
+
+    reportsNum = 0;
+    prevPeakA = -1.0;
+
+    stats.Reset(config.historySize);
+}
+
+void AsgCounter::SetupDetection(uint64_t samplePos)
+{
+    blockSize = std::max(config.blockSize, MIN_BLOCK_SIZE);
+    buffer.resize(blockSize);
+
+    decimation = config.decimation;
+    if (decimation == 0)
+        decimation = std::max(static_cast<size_t>(config.sampleRate / AUTO_DECIMATION_RATE + 0.5f), size_t(1));
+
+    useNoiseFloor = config.rmsWindow > 0;
+    if (useNoiseFloor)
+        noiseFloor.Reset(config.rmsWindow, samplePos, config.noiseEstimator, decimation);
+    excludePeaks = useNoiseFloor && config.noiseEstimator != AsgNoiseEstimator::Rms;
+
+    preFilter.Setup(config);
+    filtered.resize(preFilter.IsEnabled() ? blockSize : 0);
+
     warmup = true;
+    peakHold = 0.0f;
     bufferPtr = 0;
     state = State::BeforePeak;
-    samplePos = 0;
+    this->samplePos = samplePos;
+    sampleInCurState = 0;
     averageRMS = 0.0f;
+    firstPeakAmplitude = 0.0f;
 
-    reportsNum = 0;
-    prevPeakA = -1.0f;
+    for (size_t j = 0; j < HISTORY_SAMPLES_BEFORE; ++j)
+        lookBack[j] = 0.0f;
 
     history.resize(config.minPeakDistance + HISTORY_SAMPLES_BEFORE);
+    firstPulse.resize(history.size());
+    coarsePulses[0].resize(history.size() / decimation);
+    coarsePulses[1].resize(history.size() / decimation);
+}
+
+void AsgCounter::SetConfig(const AsgCounterConfig& newConfig)
+{
+    pendingConfig = newConfig;
+    configPending = true;
+    ApplyPendingConfig();
+}
 
-    stats.Reset();
+bool AsgCounter::IsConfigPending() const
+{
+    return configPending;
+}
+
+bool AsgCounter::ApplyPendingConfig()
+{
+    // buffers may be resized, so not in the middle of a block or a peaks group
+    if (!configPending || bufferPtr > 0 || state != State::BeforePeak)
+        return false;
+
+    const AsgCounterConfig oldConfig = config;
+    config = pendingConfig;
+    configPending = false;
+
+    const bool sampleRateChanged = config.sampleRate != oldConfig.sampleRate;
+    if (sampleRateChanged || config.blockSize != oldConfig.blockSize || config.rmsWindow != oldConfig.rmsWindow ||
+        config.noiseEstimator != oldConfig.noiseEstimator || config.decimation != oldConfig.decimation ||
+        config.highPassFrequency != oldConfig.highPassFrequency || config.humFrequency != oldConfig.humFrequency ||
+        config.lowPassFrequency != oldConfig.lowPassFrequency)
+    {
+        SetupDetection(samplePos);
+    }
+    else if (config.minPeakDistance != oldConfig.minPeakDistance)
+    {
+        history.resize(config.minPeakDistance + HISTORY_SAMPLES_BEFORE);
+        firstPulse.resize(history.size());
+        coarsePulses[0].resize(history.size() / decimation);
+        coarsePulses[1].resize(history.size() / decimation);
+    }
+
+    if (sampleRateChanged)
+        prevPeakA = -1.0;
+
+    if (config.historySize != oldConfig.historySize)
+        stats.history.SetCapacity(config.historySize);
+
+    return true;
+}
+
+bool AsgCounter::HasSameState(const AsgCounter& other) const
+{
+    if (blockSize != other.blockSize || decimation != other.decimation || useNoiseFloor != other.useNoiseFloor ||
+        excludePeaks != other.excludePeaks || warmup != other.warmup ||
+        averageRMS != other.averageRMS || peakHold != other.peakHold || state != other.state ||
+        bufferPtr != other.bufferPtr || samplePos != other.samplePos)
+        return false;
+
+    if (useNoiseFloor && !noiseFloor.HasSameState(other.noiseFloor))
+        return false;
+
+    if (!preFilter.HasSameState(other.preFilter))
+        return false;
+
+    if (memcmp(buffer.data(), other.buffer.data(), bufferPtr * sizeof(float)) != 0 ||
+        memcmp(lookBack, other.lookBack, sizeof(lookBack)) != 0)
+        return false;
+
+    // the rest matters only in the middle of a peaks group
+    if (state == State::BeforePeak)
+        return true;
+
+    if (sampleInCurState != other.sampleInCurState || peakSearchStart[0] != other.peakSearchStart[0] ||
+        history != other.history)
+        return false;
+
+    return state == State::FirstPeak ||
+        (firstPeakAmplitude == other.firstPeakAmplitude && (state != State::SecondPeak ||
+         (peakSearchStart[1] == other.peakSearchStart[1] && firstPeakEstimation == other.firstPeakEstimation &&
+          firstPulse == other.firstPulse)));
 }
 
 AsgStats& AsgCounter::GetStats()
@@ -169,22 +365,32 @@ AsgStats& AsgCounter::GetStats()
     return stats;
 }
 
+const AsgStats& AsgCounter::GetStats() const
+{
+    return stats;
+}
+
 AsgCounterConfig& AsgCounter::GetConfig()
 {
     return config;
 }
 
-void AsgCounter::ReportPeaksGroup(float peakA, float peakB)
+const AsgCounterConfig& AsgCounter::GetConfig() const
+{
+    return config;
+}
+
+void AsgCounter::ReportPeaksGroup(double peakA, double peakB, float amplitudeB)
 {
 #ifdef _DEBUG
-    printf("#%i:\t A = %.2f,\t B = %.2f", reportsNum, peakA, peakB);
+    printf("#%i:\t A = %.2f,\t B = %.2f", (int)reportsNum, peakA, peakB);
 #endif
 
     float velocity = -1.0f;
-    if (peakB > 0.0f)
+    if (peakB > peakA)  // interpolation of distorted peaks may put them on top of each other
     {
-        float sampleDist = peakB - peakA;
-        velocity = config.length * config.sampleRate / sampleDist;
+        double sampleDist = peakB - peakA;
+        velocity = static_cast<float>(config.length * config.sampleRate / sampleDist);
 #ifdef _DEBUG
         printf(",\t d = %.2f,\t m/s = %.1f", sampleDist, velocity);
 #endif
@@ -196,18 +402,68 @@ void AsgCounter::ReportPeaksGroup(float peakA, float peakB)
 
     float dt = -1.0f;
     if (prevPeakA > 0)
-        dt = (peakA - prevPeakA) / config.sampleRate;
-    stats.AddSample(velocity, dt);
+        dt = static_cast<float>((peakA - prevPeakA) / config.sampleRate);
+    stats.AddSample(velocity, dt, peakA, config);
+
+    if (callback)
+    {
+        ASG_TRACE_SCOPE("ShotCallback");
+        AsgShotEvent event;
+        event.index = reportsNum;
+        event.firstPeak = peakA;
+        event.secondPeak = peakB;
+        event.time = peakA / config.sampleRate;
+        event.velocity = velocity;
+        event.deltaTime = dt;
+        event.amplitude[0] = firstPeakAmplitude;
+        event.amplitude[1] = amplitudeB;
+        event.noiseLevel = averageRMS;
+        event.snr = averageRMS > 0.0f ? std::min(firstPeakAmplitude, amplitudeB) / averageRMS : -1.0f;
+        callback(event);
+    }
 
     prevPeakA = peakA;
     reportsNum++;
+}
 
-    if (callback)
-        callback();
+void AsgCounter::FetchHistoryBefore(const float* block, size_t i)
+{
+    // samples preceding the block are taken from the previous one
+    for (size_t j = 0; j < HISTORY_SAMPLES_BEFORE; ++j)
+    {
+        int id = (int)(i + j) - (int)HISTORY_SAMPLES_BEFORE;
+        history[j] = (id >= 0) ? block[id] : lookBack[HISTORY_SAMPLES_BEFORE + id];
+    }
+}
+
+void AsgCounter::StoreLookBack(const float* block, size_t samplesNum)
+{
+    if (samplesNum >= HISTORY_SAMPLES_BEFORE)
+    {
+        for (size_t j = 0; j < HISTORY_SAMPLES_BEFORE; ++j)
+            lookBack[j] = block[samplesNum - HISTORY_SAMPLES_BEFORE + j];
+        return;
+    }
+
+    // short block - shift the older samples
+    size_t keep = HISTORY_SAMPLES_BEFORE - samplesNum;
+    for (size_t j = 0; j < keep; ++j)
+        lookBack[j] = lookBack[j + samplesNum];
+    for (size_t j = 0; j < samplesNum; ++j)
+        lookBack[keep + j] = block[j];
+}
+
+float AsgCounter::HistoryAmplitude() const
+{
+    float amplitude = 0.0f;
+    for (size_t i = 0; i < config.minPeakDistance + HISTORY_SAMPLES_BEFORE; ++i)
+        amplitude = std::max(amplitude, fabsf(history[i]));
+    return amplitude;
 }
 
 float AsgCounter::FindPeakInHistory()
 {
+    ASG_TRACE_SCOPE("FindPeakInHistory");
     int maxID = 0;
     float tmp = -1.0f;
     for (int i = 0; i < config.minPeakDistance + HISTORY_SAMPLES_BEFORE; ++i)
@@ -249,7 +505,13 @@ float AsgCounter::FindPeakInHistory()
 
     float x = 0.5f;
     float y = 0.0f;
-    if (delta >= 0.0f)
+    if (dc2 == 0.0f)
+    {
+        // derivative is linear (e.g. clipped signal)
+        if (dc1 != 0.0f && -dc0 / dc1 >= 0.0f && -dc0 / dc1 <= 1.0f)
+            x = -dc0 / dc1;
+    }
+    else if (delta >= 0.0f)
     {
         float x0 = (-dc1 - sqrtf(delta)) / (2.0f * dc2);
         float x1 = (-dc1 + sqrtf(delta)) / (2.0f * dc2);
@@ -291,38 +553,167 @@ float AsgCounter::FindPeakInHistory()
     return static_cast<float>(maxID + offset) + x;
 }
 
-void AsgCounter::Analyze()
+float AsgCounter::CorrelatePulses()
 {
-    // calculate buffer RMS
-    float rms = 0.0f;
-    for (size_t i = 0; i < BUFFER_SIZE; ++i)
+    ASG_TRACE_SCOPE("CorrelatePulses");
+    // Both pulses are recorded from the moment they crossed the treshold, so the second one is
+    // shifted only by a few samples against the first one. Find the shift maximizing correlation.
+    const size_t length = config.minPeakDistance + HISTORY_SAMPLES_BEFORE;
+    const int maxLag = static_cast<int>(length / 2);
+
+    // remove DC offset, so the overlap length does not bias the correlation
+    float meanA = 0.0f, meanB = 0.0f;
+    for (size_t i = 0; i < length; ++i)
     {
-        float sample = buffer[i];
-        rms += sample * sample;
+        meanA += firstPulse[i];
+        meanB += history[i];
+    }
+    meanA /= static_cast<float>(length);
+    meanB /= static_cast<float>(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        firstPulse[i] -= meanA;
+        history[i] -= meanB;
     }
-    rms = sqrtf(rms / static_cast<float>(BUFFER_SIZE));
 
-    // RMS smoothing
-    if (rms > averageRMS)
-        averageRMS = rms;
-    else
-        averageRMS += 0.5f * (rms - averageRMS);
+    // with decimation, search the decimated pulses first and only the lags around the best one
+    // at full rate
+    int firstLag = -maxLag, lastLag = maxLag;
+    const size_t coarseLength = coarsePulses[0].size();
+    if (decimation > 1 && coarseLength >= MIN_COARSE_PULSE)
+    {
+        for (size_t i = 0; i < coarseLength; ++i)
+        {
+            float sumA = 0.0f, sumB = 0.0f;
+            for (size_t j = i * decimation; j < (i + 1) * decimation; ++j)
+            {
+                sumA += firstPulse[j];
+                sumB += history[j];
+            }
+            coarsePulses[0][i] = sumA;
+            coarsePulses[1][i] = sumB;
+        }
+
+        const int coarseMaxLag = static_cast<int>(coarseLength / 2);
+        float coarseBest = -FLT_MAX;
+        int coarseBestLag = 0;
+        for (int lag = -coarseMaxLag; lag <= coarseMaxLag; ++lag)
+        {
+            size_t offsetA = lag < 0 ? static_cast<size_t>(-lag) : 0;
+            size_t offsetB = lag > 0 ? static_cast<size_t>(lag) : 0;
+            float corr = AsgDotProduct(coarsePulses[0].data() + offsetA, coarsePulses[1].data() + offsetB,
+                                       coarseLength - offsetA - offsetB);
+            if (corr > coarseBest)
+            {
+                coarseBest = corr;
+                coarseBestLag = lag;
+            }
+        }
+
+        const int step = static_cast<int>(decimation);
+        firstLag = std::max(coarseBestLag * step - step, -maxLag);
+        lastLag = std::min(coarseBestLag * step + step, maxLag);
+    }
 
-    if (warmup)
+    // correlation at lags -1, 0, +1 around the best one (for interpolation)
+    float best = -FLT_MAX, before = 0.0f, after = 0.0f;
+    int bestLag = 0;
+    float prev = 0.0f;
+    for (int lag = firstLag; lag <= lastLag; ++lag)
     {
-        warmup = false;
-        samplePos += BUFFER_SIZE;
-        sampleInCurState += BUFFER_SIZE;
-        return;
+        size_t offsetA = lag < 0 ? static_cast<size_t>(-lag) : 0;
+        size_t offsetB = lag > 0 ? static_cast<size_t>(lag) : 0;
+        float corr = AsgDotProduct(firstPulse.data() + offsetA, history.data() + offsetB,
+                                   length - offsetA - offsetB);
+
+        if (lag == bestLag + 1)
+            after = corr;
+        if (corr > best)
+        {
+            before = prev;
+            best = corr;
+            bestLag = lag;
+            after = 0.0f;
+        }
+        prev = corr;
+    }
+
+    if (bestLag == firstLag || bestLag == lastLag)
+        return static_cast<float>(bestLag);
+
+    // parabolic interpolation of the correlation maximum
+    float denominator = before - 2.0f * best + after;
+    float delta = 0.0f;
+    if (denominator < 0.0f)
+        delta = 0.5f * (before - after) / denominator;
+
+    return static_cast<float>(bestLag) + std::max(-0.5f, std::min(delta, 0.5f));
+}
+
+void AsgCounter::Analyze(const float* block, size_t samplesNum)
+{
+    ASG_TRACE_SCOPE("Analyze");
+    const uint64_t blockPos = samplePos;
+    bool blockInNoiseFloor = false;
+    if (useNoiseFloor)
+    {
+        // treshold is based on the past samples only, the very first block is used to bootstrap it
+        if (noiseFloor.IsEmpty())
+        {
+            noiseFloor.Push(block, samplesNum, blockPos);
+            blockInNoiseFloor = true;
+        }
+        averageRMS = noiseFloor.GetRMS();
+
+        // the gun's report following the shot can be much louder than the noise floor
+        peakHold *= exp2f(-static_cast<float>(samplesNum) / PEAK_HOLD_HALF_LIFE);
+        if (PEAK_HOLD_RATIO * peakHold < TRESHOLD_OFFSET)
+            peakHold = 0.0f;  // can't affect the treshold anymore
     }
+    else
+    {
+        // calculate block RMS
+        float rms = sqrtf(AsgSumSquares(block, samplesNum) / static_cast<float>(samplesNum));
+
+        // RMS smoothing
+        if (rms > averageRMS)
+            averageRMS = rms;
+        else
+            averageRMS += 0.5f * (rms - averageRMS);
 
-    rms = averageRMS;
-    const float tresholdOffset = 0.001f;
-    float treshold = config.detectionSigma * rms + tresholdOffset;
+        if (warmup)
+        {
+            warmup = false;
+            samplePos += samplesNum;
+            sampleInCurState += samplesNum;
+            StoreLookBack(block, samplesNum);
+            return;
+        }
+    }
 
-    for (size_t i = 0; i < BUFFER_SIZE; ++i)
+    float rms = averageRMS;
+    const float noiseTreshold = config.detectionSigma * rms + TRESHOLD_OFFSET;
+    float treshold = noiseTreshold;
+    if (useNoiseFloor)
+        treshold = std::max(noiseTreshold, PEAK_HOLD_RATIO * peakHold);
+
+    // beginning of the samples outside of peaks groups to be pushed into the noise floor
+    size_t quietStart = state == State::BeforePeak ? 0 : samplesNum;
+
+    for (size_t i = 0; i < samplesNum; ++i)
     {
-        float sample = buffer[i];
+        if (state == State::BeforePeak)
+        {
+            // skip the silence (vast majority of samples) at once
+            size_t skipped = AsgFindFirstAbove(block + i, samplesNum - i, treshold);
+            samplePos += skipped;
+            sampleInCurState += skipped;
+            i += skipped;
+            if (i == samplesNum)
+                break;
+        }
+
+        float sample = block[i];
         bool above = (sample > treshold) || (-sample > treshold);
 
         if (above && state == State::BeforePeak) // before any peak
@@ -331,11 +722,11 @@ void AsgCounter::Analyze()
             state = State::FirstPeak;
             sampleInCurState = 0;
 
-            for (size_t j = 0; j < HISTORY_SAMPLES_BEFORE; ++j)
-            {
-                int id = (int)(i + j) - (int)HISTORY_SAMPLES_BEFORE;
-                history[j] = (id >= 0) ? buffer[id] : 0.0f;  // TODO
-            }
+            if (excludePeaks && !blockInNoiseFloor)
+                noiseFloor.Push(block + quietStart, i - quietStart, blockPos + quietStart);
+            quietStart = samplesNum;
+
+            FetchHistoryBefore(block, i);
             history[HISTORY_SAMPLES_BEFORE] = sample;
         }
         else if (state == State::FirstPeak)  // first peak
@@ -344,6 +735,14 @@ void AsgCounter::Analyze()
             {
                 state = State::BetweenPeaks;
                 sampleInCurState = 0;
+                firstPeakAmplitude = HistoryAmplitude();
+
+                // do not take ringing of the first peak for the second one
+                if (useNoiseFloor)
+                {
+                    peakHold = std::max(peakHold, firstPeakAmplitude);
+                    treshold = std::max(noiseTreshold, PEAK_HOLD_RATIO * peakHold);
+                }
             }
             else
                 history[sampleInCurState + HISTORY_SAMPLES_BEFORE] = sample;
@@ -356,31 +755,38 @@ void AsgCounter::Analyze()
                 state = State::SecondPeak;
                 sampleInCurState = 0;
 
-                firstPeakEstimation = peakSearchStart[0] + FindPeakInHistory();
+                firstPeakEstimation = static_cast<double>(peakSearchStart[0]) + FindPeakInHistory();
+                if (config.peakEstimator == AsgPeakEstimator::CrossCorrelation)
+                    firstPulse = history;
 
-                // TODO
-                for (size_t j = 0; j < HISTORY_SAMPLES_BEFORE; ++j)
-                {
-                    int id = (int)(i + j) - (int)HISTORY_SAMPLES_BEFORE;
-                    history[j] = (id >= 0) ? buffer[id] : 0.0f;  // TODO
-                }
+                FetchHistoryBefore(block, i);
                 history[HISTORY_SAMPLES_BEFORE] = sample;
             }
             else if (sampleInCurState >= config.maxPeakDistance)
             {
                 // distance between peaks is too large - ignore it
-                firstPeakEstimation = peakSearchStart[0] + FindPeakInHistory();
-                ReportPeaksGroup(firstPeakEstimation, -1.0f);
+                firstPeakEstimation = static_cast<double>(peakSearchStart[0]) + FindPeakInHistory();
+                ReportPeaksGroup(firstPeakEstimation, -1.0, 0.0f);
                 state = State::BeforePeak;
+                quietStart = i + 1;
             }
         }
         else if (state == State::SecondPeak)  // second peak
         {
             if (sampleInCurState >= config.minPeakDistance)
             {
-                float secondPeakEstimation = peakSearchStart[1] + FindPeakInHistory();
-                ReportPeaksGroup(firstPeakEstimation, secondPeakEstimation);
+                float secondPeakAmplitude = HistoryAmplitude();
+                double secondPeakEstimation;
+                if (config.peakEstimator == AsgPeakEstimator::CrossCorrelation)
+                {
+                    secondPeakEstimation = firstPeakEstimation +
+                        static_cast<double>(peakSearchStart[1] - peakSearchStart[0]) + CorrelatePulses();
+                }
+                else
+                    secondPeakEstimation = static_cast<double>(peakSearchStart[1]) + FindPeakInHistory();
+                ReportPeaksGroup(firstPeakEstimation, secondPeakEstimation, secondPeakAmplitude);
                 state = State::BeforePeak;
+                quietStart = i + 1;
             }
             else
                 history[sampleInCurState + HISTORY_SAMPLES_BEFORE] = sample;
@@ -390,23 +796,97 @@ void AsgCounter::Analyze()
         sampleInCurState++;
     }
 
+    if (excludePeaks && !blockInNoiseFloor)
+        noiseFloor.Push(block + quietStart, samplesNum - quietStart, blockPos + quietStart);
+    else if (useNoiseFloor && !blockInNoiseFloor)
+        noiseFloor.Push(block, samplesNum, blockPos);
+
+    StoreLookBack(block, samplesNum);
+
     // printf("RMS = %f, treshold = %f\n", rms, treshold);
 }
 
-void AsgCounter::ProcessBuffer(float* samples, size_t samplesNum)
+void AsgCounter::FilterAndAnalyze(const float* block, size_t samplesNum)
 {
-    for (size_t i = 0; i < samplesNum; ++i)
+    if (preFilter.IsEnabled())
     {
-        buffer[bufferPtr++] = samples[i];
-        if (bufferPtr == BUFFER_SIZE)
+        ASG_TRACE_SCOPE("PreFilter");
+        preFilter.Process(block, filtered.data(), samplesNum);
+        block = filtered.data();
+    }
+
+    Analyze(block, samplesNum);
+}
+
+void AsgCounter::ProcessBuffer(const float* samples, size_t samplesNum)
+{
+    ASG_TRACE_SCOPE("ProcessBuffer");
+    if (useNoiseFloor)
+    {
+        // treshold does not depend on the block contents - no need to wait for a full block
+        while (samplesNum > 0)
+        {
+            if (ApplyPendingConfig())
+            {
+                ProcessBuffer(samples, samplesNum);  // block size or noise estimation may differ
+                return;
+            }
+
+            size_t toAnalyze = std::min(blockSize, samplesNum);
+            FilterAndAnalyze(samples, toAnalyze);
+            samples += toAnalyze;
+            samplesNum -= toAnalyze;
+        }
+        return;
+    }
+
+    // complete the block started by the previous call
+    if (bufferPtr > 0)
+    {
+        size_t toCopy = std::min(blockSize - bufferPtr, samplesNum);
+        memcpy(buffer.data() + bufferPtr, samples, toCopy * sizeof(float));
+        bufferPtr += toCopy;
+        samples += toCopy;
+        samplesNum -= toCopy;
+
+        if (bufferPtr < blockSize)
+            return;
+
+        FilterAndAnalyze(buffer.data(), blockSize);
+        bufferPtr = 0;
+    }
+
+    // analyze whole blocks directly in the caller's memory
+    while (samplesNum >= blockSize)
+    {
+        if (ApplyPendingConfig())
         {
-            Analyze();
-            bufferPtr = 0;
+            ProcessBuffer(samples, samplesNum);
+            return;
         }
+
+        FilterAndAnalyze(samples, blockSize);
+        samples += blockSize;
+        samplesNum -= blockSize;
+    }
+
+    if (ApplyPendingConfig())
+    {
+        ProcessBuffer(samples, samplesNum);
+        return;
     }
+
+    // keep the remainder until the next call
+    memcpy(buffer.data(), samples, samplesNum * sizeof(float));
+    bufferPtr = samplesNum;
 }
 
 void AsgCounter::SetCallback(AsgEventCallback callback)
 {
     this->callback = callback;
+}
+
+size_t AsgCounter::GetBlockSize() const
+{
+    return blockSize;
 }
\ No newline at end of file
@@ -2,6 +2,19 @@
 
 #include <vector>
 #include <functional>
+#include <cstdint>
+
+#include "NoiseFloor.h"
+#include "PreFilter.h"
+#include "BroadcastRing.h"
+#include "ShotHistory.h"
+#include "QuantileSketch.h"
+
+enum class AsgPeakEstimator
+{
+    Hermite,            // interpolated maximum of every peak (cheap)
+    CrossCorrelation    // delay between the whole pulses (more robust to noise)
+};
 
 struct AsgCounterConfig
 {
@@ -17,18 +30,46 @@ struct AsgCounterConfig
     float detectionSigma;
     float fireRateTreshold;
 
-    AsgCounterConfig();
-};
+    size_t blockSize;       // analysis block size (in samples)
 
-struct AsgStatsSample
-{
-    float velocity;
-    float deltaTime;
+    // Noise floor window (in samples). If zero, the treshold is based on RMS of the block being
+    // analyzed, which requires waiting for the whole block and skipping the first one.
+    // Otherwise sliding window of the past samples is used and events are reported immediately
+    // (needs higher detectionSigma, because the shot itself does not raise the treshold).
+    size_t rmsWindow;
+
+    // Statistic of the noise floor window. The median ignores the detected peaks groups, so it
+    // stays at the noise level even at high fire rates.
+    AsgNoiseEstimator noiseEstimator;
+
+    // Decimation for high sample rates: the noise floor window keeps every n-th sample and
+    // cross-correlation searches the decimated pulses first. The peaks are always located at full
+    // rate. 1 - disabled, 0 - chosen from the sample rate (about 48 kHz after decimation).
+    size_t decimation;
+
+    // How the distance between the twin peaks is measured (the first peak position used for
+    // fire rate is always interpolated).
+    AsgPeakEstimator peakEstimator;
+
+    // Pre-filter applied to the samples before detection (frequencies in Hz, 0 - disabled).
+    float highPassFrequency;    // DC offset and low-frequency drift removal
+    float humFrequency;         // mains frequency (50 or 60 Hz), notches the hum and its harmonics
+    float lowPassFrequency;
+
+    // Shots kept in the stats history (0 - unlimited). The statistics of the whole session are
+    // not affected, only the windowed ones are limited to the kept shots.
+    size_t historySize;
+
+    AsgCounterConfig();
 };
 
-struct AsgStats
+/**
+ * Statistics without the shots history (copied without allocations).
+ */
+struct AsgStatsSummary
 {
-    std::vector<AsgStatsSample> history;
+    size_t shotsNum;
+    size_t velocitySamplesNum;  // shots with valid velocity
 
     // velocity in meters per second
     float velocityAvg, velocityMin, velocityMax, velocityStdDev;
@@ -36,14 +77,93 @@ struct AsgStats
     // fire rate in rounds per second
     float fireRateAvg, fireRateMin, fireRateMax, fireRateStdDev;
 
+    // distributions of the valid velocities and of the fire rates within bursts (for percentiles)
+    AsgQuantileSketch velocitySketch;
+    AsgQuantileSketch fireRateSketch;
+
+    /**
+     * Estimated number of the shots with energy over "energy" joules for BB mass "mass" in kg.
+     */
+    uint64_t CountShotsAboveEnergy(float energy, float mass) const;
+};
+
+/**
+ * Shots history and statistics. Statistics of the whole session are updated incrementally in
+ * AddSample(), so reading them does not depend on the history length.
+ */
+struct AsgStats : public AsgStatsSummary
+{
+    AsgShotHistory history;
+
     AsgStats();
+
+    /**
+     * Clear the statistics and the history (keeps the history capacity).
+     */
     void Reset();
-    void AddSample(float velocity, float deltaTime);
-    void Calc(const AsgCounterConfig& cfg);
+    void Reset(size_t historySize);
+
+    void AddSample(float velocity, float deltaTime, double position, const AsgCounterConfig& cfg);
+
+    /**
+     * Update the statistics without keeping the shot in the history, e.g. for a window of the shots
+     * updated incrementally (deltaTime -1 for the first shot of the window).
+     */
+    void AddSummarySample(float velocity, float deltaTime, const AsgCounterConfig& cfg);
+
     void Print() const;
+
+    /**
+     * Statistics of the last "shotsNum" shots (limited to the kept ones).
+     */
+    AsgStatsSummary GetSummary(size_t shotsNum, const AsgCounterConfig& cfg) const;
+
+    /**
+     * Number of the shots since the last pause longer than "pause" seconds, e.g. a magazine change
+     * (limited to the kept ones).
+     */
+    size_t CountShotsSincePause(float pause) const;
+
+private:
+    // running velocity mean and variance
+    double velocityMean, velocityM2;
+
+    // recent burst of shots with similar intervals (for fire rate)
+    size_t burstSamples;
+    float burstSum, burstMin, burstMax;
+    bool burstSemiAuto;
+
+    void UpdateVelocity(float velocity);
+    void UpdateFireRate(float dt, float fireRateTreshold);
+};
+
+/**
+ * Detected peaks group passed to the event callback. Positions are interpolated and counted in
+ * samples since the beginning of the stream, double precision keeps sub-sample resolution for
+ * years of samples.
+ */
+struct AsgShotEvent
+{
+    uint64_t index;         // shot number since Reset()
+    double firstPeak;
+    double secondPeak;      // -1 if the second peak was not found in time
+    double time;            // first peak time in seconds
+    float velocity;         // in m/s, -1 if not measured
+    float deltaTime;        // seconds since the previous shot, -1 for the first one
+
+    // quality of the detection
+    float amplitude[2];     // absolute amplitude of the peaks (0 if not found)
+    float noiseLevel;       // noise RMS the treshold was based on
+    float snr;              // weaker peak amplitude to the noise level
 };
 
-typedef std::function<void()> AsgEventCallback;
+typedef std::function<void(const AsgShotEvent& event)> AsgEventCallback;
+
+/**
+ * Shot events for any number of consumers, fed by the counter's callback:
+ *   counter.SetCallback([&queue](const AsgShotEvent& event) { queue.Push(event); });
+ */
+typedef AsgBroadcastRing<AsgShotEvent> AsgShotEventQueue;
 
 class AsgCounter
 {
@@ -55,44 +175,115 @@ class AsgCounter
         SecondPeak
     };
 
-    static const size_t BUFFER_SIZE = 8192;
+    static const size_t MIN_BLOCK_SIZE = 16;
+    static const size_t HISTORY_SAMPLES_BEFORE = 2;  // for Hermite interpolation
+    static const size_t MIN_COARSE_PULSE = 8;  // shorter decimated pulses are not searched
 
     AsgCounterConfig config;
+    AsgCounterConfig pendingConfig;  // set by SetConfig(), waiting for a safe point
+    bool configPending;
     AsgStats stats;
     AsgEventCallback callback;
 
+    size_t blockSize;
+    size_t decimation;
+    bool useNoiseFloor;
+    bool excludePeaks;  // keep peaks groups out of the noise floor
+    AsgNoiseFloor noiseFloor;
+    AsgPreFilter preFilter;
+    std::vector<float> filtered;  // pre-filtered block
+
     bool warmup;
     float averageRMS;
+    float peakHold;  // amplitude of the recently detected peaks
     State state;
-    int peakSearchStart[2];
+    uint64_t peakSearchStart[2];
 
+    // holds incomplete block between ProcessBuffer() calls
     std::vector<float> buffer;
     size_t bufferPtr;
 
-    size_t samplePos;  // samples passed since Reset()
+    // last samples of the previous block (for peak interpolation)
+    float lookBack[HISTORY_SAMPLES_BEFORE];
+
+    uint64_t samplePos;  // stream position (samples passed since Reset())
     size_t sampleInCurState;  // samples passed since last state change
 
-    int reportsNum;
-    float prevPeakA;
+    uint64_t reportsNum;
+    double prevPeakA;
 
-    float firstPeakEstimation;
+    double firstPeakEstimation;
+    float firstPeakAmplitude;
     std::vector<float> history;
+    std::vector<float> firstPulse;  // history of the first peak (for cross-correlation)
+    std::vector<float> coarsePulses[2];  // decimated first and second pulse
 
-    void ReportPeaksGroup(float peakA, float peakB);
+    void SetupDetection(uint64_t samplePos);
+    bool ApplyPendingConfig();
+    void ReportPeaksGroup(double peakA, double peakB, float amplitudeB);
+    void FetchHistoryBefore(const float* block, size_t i);
+    void StoreLookBack(const float* block, size_t samplesNum);
+    float HistoryAmplitude() const;
     float FindPeakInHistory();
-    void Analyze();
+    float CorrelatePulses();
+    void Analyze(const float* block, size_t samplesNum);
+    void FilterAndAnalyze(const float* block, size_t samplesNum);
 
 public:
     AsgCounter();
     void Reset();
 
+    /**
+     * Reset and start counting samples from "samplePos" instead of zero, for analyzing a part of
+     * a longer stream (reported positions are relative to the beginning of the stream).
+     */
+    void Reset(uint64_t samplePos);
+
+    /**
+     * Check if detection state of both counters is the same, i.e. given the same input they
+     * will report the same shots from now on (the statistics are not compared).
+     */
+    bool HasSameState(const AsgCounter& other) const;
+
     AsgStats& GetStats();
+    const AsgStats& GetStats() const;
+
+    /**
+     * Config in use. Changes made through the reference are applied in Reset(), which also drops
+     * a config still pending from SetConfig().
+     */
     AsgCounterConfig& GetConfig();
+    const AsgCounterConfig& GetConfig() const;
+
+    /**
+     * Change the config keeping the statistics and the stream position, e.g. while tuning a live
+     * session. The config is applied outside of peaks groups at the next block boundary (right away
+     * if possible). Changes of the block size, noise floor, pre-filter or sample rate restart
+     * the noise estimation, and the interval to the next shot is unknown after a sample rate change.
+     */
+    void SetConfig(const AsgCounterConfig& config);
 
+    /**
+     * True if the config passed to SetConfig() hasn't been applied yet (nor dropped by Reset()).
+     */
+    bool IsConfigPending() const;
+
+    /**
+     * Set callback called on every detected peaks group (from the thread calling ProcessBuffer()).
+     */
     void SetCallback(AsgEventCallback callback);
 
+    /**
+     * Analysis block size in use (config.blockSize is applied in Reset()).
+     */
+    size_t GetBlockSize() const;
+
     /**
      * Process samples buffer (detect and count peaks).
+     * Whole blocks are analyzed directly in the caller's memory (unless the pre-filter is enabled),
+     * only the remainder is copied.
+     * With sliding noise floor (config.rmsWindow > 0) nothing is copied and every sample is analyzed
+     * immediately, so events are reported without waiting for a full block.
      */
-    void ProcessBuffer(float* samples, size_t samplesNum);
+    void ProcessBuffer(const float* samples, size_t samplesNum);
 };
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "LatencyHistogram.h"
+
+const uint32_t AsgLatencyHistogram::SUB_BUCKETS;
+const uint32_t AsgLatencyHistogram::MAX_MAGNITUDE;
+const uint32_t AsgLatencyHistogram::BUCKETS_NUM;
+
+namespace {
+
+// index of the highest bit set
+uint32_t GetMagnitude(uint64_t value)
+{
+    uint32_t magnitude = 0;
+    for (uint32_t step = 32; step > 0; step /= 2)
+    {
+        if ((value >> (magnitude + step)) != 0)
+            magnitude += step;
+    }
+    return magnitude;
+}
+
+} // namespace
+
+AsgLatencyHistogram::AsgLatencyHistogram()
+{
+    Reset();
+}
+
+void AsgLatencyHistogram::Reset()
+{
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    sum = 0;
+    maxValue = 0;
+}
+
+uint32_t AsgLatencyHistogram::GetBucket(uint64_t value)
+{
+    if (value < 2 * SUB_BUCKETS)
+        return static_cast<uint32_t>(value);
+
+    value = std::min(value, (uint64_t(1) << MAX_MAGNITUDE) - 1);
+
+    // 64 buckets per power of two, the top 7 bits of the value select the bucket
+    const uint32_t shift = GetMagnitude(value) - 6;
+    return shift * SUB_BUCKETS + static_cast<uint32_t>(value >> shift);
+}
+
+uint64_t AsgLatencyHistogram::GetBucketValue(uint32_t bucket)
+{
+    if (bucket < 2 * SUB_BUCKETS)
+        return bucket;
+
+    const uint32_t shift = bucket / SUB_BUCKETS - 1;
+    const uint64_t top = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+void AsgLatencyHistogram::Record(uint64_t latency)
+{
+    counts[GetBucket(latency)]++;
+    count++;
+    sum += latency;
+    maxValue = std::max(maxValue, latency);
+}
+
+void AsgLatencyHistogram::Merge(const AsgLatencyHistogram& other)
+{
+    for (uint32_t i = 0; i < BUCKETS_NUM; ++i)
+        counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+uint64_t AsgLatencyHistogram::GetCount() const
+{
+    return count;
+}
+
+uint64_t AsgLatencyHistogram::GetMax() const
+{
+    return maxValue;
+}
+
+double AsgLatencyHistogram::GetMean() const
+{
+    return count > 0 ? static_cast<double>(sum) / static_cast<double>(count) : 0.0;
+}
+
+uint64_t AsgLatencyHistogram::GetPercentile(double fraction) const
+{
+    if (count == 0)
+        return 0;
+
+    const double rank = std::max(fraction, 0.0) * static_cast<double>(count);
+    uint64_t cumulative = 0;
+    for (uint32_t i = 0; i < BUCKETS_NUM; ++i)
+    {
+        cumulative += counts[i];
+        if (counts[i] > 0 && static_cast<double>(cumulative) >= rank)
+            return std::min(GetBucketValue(i), maxValue);
+    }
+    return maxValue;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Histogram of latencies in nanoseconds with log-linear buckets (HDR style): values below 128 ns
+ * are counted exactly, larger ones in 64 buckets per power of two, so percentiles are within 1.6%
+ * of the recorded values. Values over about 18 minutes are counted in the last bucket. Storage is
+ * fixed, recording is a few instructions without allocations.
+ */
+class AsgLatencyHistogram
+{
+    static const uint32_t SUB_BUCKETS = 64;
+    static const uint32_t MAX_MAGNITUDE = 40;  // of the largest value (in bits)
+    static const uint32_t BUCKETS_NUM = 2 * SUB_BUCKETS + (MAX_MAGNITUDE - 7) * SUB_BUCKETS;
+
+    uint32_t counts[BUCKETS_NUM];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t maxValue;
+
+    static uint32_t GetBucket(uint64_t value);
+    static uint64_t GetBucketValue(uint32_t bucket);  // highest value in the bucket
+
+public:
+    AsgLatencyHistogram();
+
+    void Reset();
+    void Record(uint64_t latency);
+
+    /**
+     * Add counts of another histogram.
+     */
+    void Merge(const AsgLatencyHistogram& other);
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+
+    /**
+     * Latency not exceeded by the given fraction (0 - 1) of the recorded ones, 0 if empty.
+     */
+    uint64_t GetPercentile(double fraction) const;
+};
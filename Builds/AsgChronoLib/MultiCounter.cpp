@@ -0,0 +1,149 @@
+#include "stdafx.h"
+#include "MultiCounter.h"
+
+AsgMultiCounter::AsgMultiCounter()
+{
+    Setup(1, AsgCounterConfig(), 1);
+}
+
+void AsgMultiCounter::Setup(size_t channelsNum, const AsgCounterConfig& config, size_t threadsNum)
+{
+    if (threadsNum == 0)
+        threadsNum = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    threadsNum = std::min(threadsNum, std::max<size_t>(channelsNum, 1));
+
+    if (!workerPool || workerPool->GetThreadsNum() != threadsNum)
+        workerPool.reset(new AsgWorkerPool(threadsNum));
+
+    counters.clear();
+    deinterleaved.resize(channelsNum);
+    for (size_t i = 0; i < channelsNum; ++i)
+    {
+        counters.push_back(std::unique_ptr<AsgCounter>(new AsgCounter));
+        counters[i]->GetConfig() = config;
+        counters[i]->Reset();
+    }
+
+    SetCallback(callback);
+}
+
+void AsgMultiCounter::Reset()
+{
+    for (size_t i = 0; i < counters.size(); ++i)
+        counters[i]->Reset();
+}
+
+size_t AsgMultiCounter::GetChannelsNum() const
+{
+    return counters.size();
+}
+
+AsgCounter& AsgMultiCounter::GetCounter(size_t channel)
+{
+    return *counters[channel];
+}
+
+const AsgCounter& AsgMultiCounter::GetCounter(size_t channel) const
+{
+    return *counters[channel];
+}
+
+void AsgMultiCounter::SetCallback(AsgMultiEventCallback callback)
+{
+    this->callback = callback;
+
+    for (size_t i = 0; i < counters.size(); ++i)
+    {
+        if (callback)
+            counters[i]->SetCallback(std::bind(callback, i, std::placeholders::_1));
+        else
+            counters[i]->SetCallback(AsgEventCallback());
+    }
+}
+
+void AsgMultiCounter::ProcessBuffers(const float* const* channels, size_t samplesNum)
+{
+    workerPool->ParallelFor(counters.size(), [&](size_t i)
+    {
+        if (channels[i])
+            counters[i]->ProcessBuffer(channels[i], samplesNum);
+    });
+}
+
+void AsgMultiCounter::ProcessInterleaved(const float* samples, size_t framesNum)
+{
+    const size_t channelsNum = counters.size();
+
+    // every worker deinterleaves its own channel
+    workerPool->ParallelFor(channelsNum, [&](size_t i)
+    {
+        std::vector<float>& channel = deinterleaved[i];
+        if (channel.size() < framesNum)
+            channel.resize(framesNum);
+
+        for (size_t j = 0; j < framesNum; ++j)
+            channel[j] = samples[j * channelsNum + i];
+
+        counters[i]->ProcessBuffer(channel.data(), framesNum);
+    });
+}
+
+AsgStatsSummary AsgMultiCounter::GetCombinedSummary() const
+{
+    AsgStatsSummary combined;
+    combined.shotsNum = 0;
+    combined.velocitySamplesNum = 0;
+    combined.velocityMin = FLT_MAX;
+    combined.velocityMax = FLT_MIN;
+    combined.velocityAvg = -1.0f;
+    combined.velocityStdDev = -1.0f;
+    combined.fireRateAvg = -1.0f;
+    combined.fireRateMin = -1.0f;
+    combined.fireRateMax = -1.0f;
+    combined.fireRateStdDev = -1.0f;
+
+    // merge means and variances of the channels
+    double mean = 0.0;
+    double m2 = 0.0;
+    for (size_t i = 0; i < counters.size(); ++i)
+    {
+        const AsgStatsSummary& stats = counters[i]->GetStats();
+        combined.shotsNum += stats.shotsNum;
+        if (stats.velocitySamplesNum == 0)
+            continue;
+
+        double n = static_cast<double>(stats.velocitySamplesNum);
+        double total = static_cast<double>(combined.velocitySamplesNum) + n;
+        double delta = stats.velocityAvg - mean;
+        mean += delta * n / total;
+        m2 += n * stats.velocityStdDev * stats.velocityStdDev +
+            delta * delta * n * static_cast<double>(combined.velocitySamplesNum) / total;
+        combined.velocitySamplesNum += stats.velocitySamplesNum;
+
+        combined.velocityMin = std::min(combined.velocityMin, stats.velocityMin);
+        combined.velocityMax = std::max(combined.velocityMax, stats.velocityMax);
+        combined.velocitySketch.Merge(stats.velocitySketch);
+    }
+
+    if (combined.velocitySamplesNum > 0)
+    {
+        combined.velocityAvg = static_cast<float>(mean);
+        combined.velocityStdDev = static_cast<float>(sqrt(m2 / static_cast<double>(combined.velocitySamplesNum)));
+    }
+
+    return combined;
+}
+
+void AsgMultiCounter::Print() const
+{
+    for (size_t i = 0; i < counters.size(); ++i)
+    {
+        printf("Channel #%i ", (int)i);
+        counters[i]->GetStats().Print();
+    }
+
+    AsgStatsSummary combined = GetCombinedSummary();
+    printf("All channels (%i samples): velocity avg = %.1f, min = %.1f, max = %.1f, std. dev. = %.2f\n",
+           (int)combined.shotsNum, combined.velocityAvg, combined.velocityMin, combined.velocityMax,
+           combined.velocityStdDev);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+
+#include "Counter.h"
+#include "WorkerPool.h"
+
+typedef std::function<void(size_t channel, const AsgShotEvent& event)> AsgMultiEventCallback;
+
+/**
+ * Runs independent AsgCounter for every input channel (e.g. multiple lanes or photocell gates),
+ * channels are processed in parallel on a worker pool.
+ */
+class AsgMultiCounter
+{
+    std::vector<std::unique_ptr<AsgCounter>> counters;
+    std::vector<std::vector<float>> deinterleaved;
+    std::unique_ptr<AsgWorkerPool> workerPool;
+    AsgMultiEventCallback callback;
+
+public:
+    AsgMultiCounter();
+
+    /**
+     * Create counters for "channelsNum" channels (all using the same config) and a pool of
+     * "threadsNum" threads (0 - number of hardware threads).
+     */
+    void Setup(size_t channelsNum, const AsgCounterConfig& config, size_t threadsNum = 0);
+    void Reset();
+
+    size_t GetChannelsNum() const;
+    AsgCounter& GetCounter(size_t channel);
+    const AsgCounter& GetCounter(size_t channel) const;
+
+    /**
+     * Set callback called on every event. Note that it is called from the worker threads.
+     */
+    void SetCallback(AsgMultiEventCallback callback);
+
+    /**
+     * Process planar buffers (one pointer per channel, null pointers are skipped).
+     */
+    void ProcessBuffers(const float* const* channels, size_t samplesNum);
+
+    /**
+     * Process interleaved buffer of "framesNum" frames.
+     */
+    void ProcessInterleaved(const float* samples, size_t framesNum);
+
+    /**
+     * Get velocity statistics of all channels combined.
+     * Fire rate is not defined across channels, so it is set to -1.
+     */
+    AsgStatsSummary GetCombinedSummary() const;
+
+    void Print() const;
+};
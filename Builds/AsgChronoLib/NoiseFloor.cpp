@@ -0,0 +1,186 @@
+#include "stdafx.h"
+#include "NoiseFloor.h"
+
+// amplitude bins are the exponent and top mantissa bits of the float
+const int BIN_MANTISSA_BITS = 3;                        // 8 bins per octave (9% wide)
+const uint32_t FIRST_BIN = 98u << BIN_MANTISSA_BITS;    // 2^-29, everything quieter falls into bin 0
+const float MEDIAN_TO_SIGMA = 1.4826f;                  // median absolute value of Gaussian noise is 0.6745 sigma
+
+static inline size_t AmplitudeBin(float sample)
+{
+    float amplitude = fabsf(sample);
+    uint32_t bits;
+    memcpy(&bits, &amplitude, sizeof(bits));
+
+    uint32_t bin = bits >> (23 - BIN_MANTISSA_BITS);
+    bin = bin > FIRST_BIN ? bin - FIRST_BIN : 0;
+    return std::min<uint32_t>(bin, UINT8_MAX);  // bins are stored as bytes
+}
+
+// lower bound of the bin amplitudes
+static inline float BinAmplitude(size_t bin)
+{
+    if (bin == 0)
+        return 0.0f;
+
+    uint32_t bits = static_cast<uint32_t>(bin + FIRST_BIN) << (23 - BIN_MANTISSA_BITS);
+    float amplitude;
+    memcpy(&amplitude, &bits, sizeof(amplitude));
+    return amplitude;
+}
+
+AsgNoiseFloor::AsgNoiseFloor()
+{
+    Reset(1);
+}
+
+void AsgNoiseFloor::Reset(size_t windowSize, uint64_t samplePos, AsgNoiseEstimator estimator, size_t decimation)
+{
+    this->estimator = estimator;
+    this->decimation = std::max<size_t>(decimation, 1);
+    this->windowSize = std::max<size_t>(windowSize / this->decimation, 1);
+    writePtr = static_cast<size_t>((samplePos + this->decimation - 1) / this->decimation % this->windowSize);
+    filled = 0;
+
+    if (estimator == AsgNoiseEstimator::Rms)
+    {
+        squares.assign(this->windowSize, 0.0f);
+        sum = 0.0;
+        bins.clear();
+        counts.clear();
+    }
+    else
+    {
+        squares.clear();
+        bins.assign(this->windowSize, 0);
+        counts.assign(BINS_NUM, 0);
+        medianBin = 0;
+        belowMedian = 0;
+    }
+}
+
+void AsgNoiseFloor::Push(const float* samples, size_t samplesNum, uint64_t samplePos)
+{
+    // keep the samples at stream positions divisible by the decimation
+    size_t first = static_cast<size_t>((decimation - samplePos % decimation) % decimation);
+    if (first >= samplesNum)
+        return;
+
+    if (estimator == AsgNoiseEstimator::Rms)
+        PushSquares(samples + first, samplesNum - first, decimation);
+    else
+        PushBins(samples + first, samplesNum - first, decimation);
+}
+
+void AsgNoiseFloor::PushSquares(const float* samples, size_t samplesNum, size_t stride)
+{
+    size_t pushed = 0;
+    for (size_t i = 0; i < samplesNum; i += stride, ++pushed)
+    {
+        float square = samples[i] * samples[i];
+        sum += square - squares[writePtr];
+        squares[writePtr] = square;
+
+        if (++writePtr == windowSize)
+        {
+            writePtr = 0;
+
+            // get rid of accumulated rounding errors once per window
+            sum = 0.0;
+            for (size_t j = 0; j < windowSize; ++j)
+                sum += squares[j];
+        }
+    }
+
+    filled = std::min(filled + pushed, windowSize);
+}
+
+void AsgNoiseFloor::PushBins(const float* samples, size_t samplesNum, size_t stride)
+{
+    size_t i = 0;
+
+    // filling the window
+    for (; i < samplesNum && filled < windowSize; i += stride, ++filled)
+    {
+        size_t bin = AmplitudeBin(samples[i]);
+        bins[writePtr] = static_cast<uint8_t>(bin);
+        counts[bin]++;
+        belowMedian += bin < medianBin;
+
+        if (++writePtr == windowSize)
+            writePtr = 0;
+    }
+
+    // replacing the oldest samples
+    for (; i < samplesNum; i += stride)
+    {
+        size_t oldBin = bins[writePtr];
+        size_t bin = AmplitudeBin(samples[i]);
+        bins[writePtr] = static_cast<uint8_t>(bin);
+        counts[oldBin]--;
+        counts[bin]++;
+        belowMedian += static_cast<size_t>(bin < medianBin) - static_cast<size_t>(oldBin < medianBin);
+
+        if (++writePtr == windowSize)
+            writePtr = 0;
+    }
+
+    if (filled == 0)
+        return;
+
+    // move the cursor to the bin holding the median
+    size_t rank = (filled - 1) / 2;
+    while (belowMedian + counts[medianBin] <= rank)
+        belowMedian += counts[medianBin++];
+    while (belowMedian > rank)
+        belowMedian -= counts[--medianBin];
+}
+
+bool AsgNoiseFloor::IsEmpty() const
+{
+    return filled == 0;
+}
+
+float AsgNoiseFloor::GetRMS() const
+{
+    if (filled == 0)
+        return 0.0f;
+
+    if (estimator == AsgNoiseEstimator::Rms)
+        return sqrtf(static_cast<float>(std::max(sum, 0.0) / static_cast<double>(filled)));
+
+    // assume the amplitudes are spread uniformly within the bin
+    size_t rank = (filled - 1) / 2;
+    float fraction = (static_cast<float>(rank - belowMedian) + 0.5f) / static_cast<float>(counts[medianBin]);
+    float low = BinAmplitude(medianBin);
+    float high = BinAmplitude(medianBin + 1);
+    return MEDIAN_TO_SIGMA * (low + fraction * (high - low));
+}
+
+bool AsgNoiseFloor::HasSameState(const AsgNoiseFloor& other) const
+{
+    if (estimator != other.estimator || decimation != other.decimation || windowSize != other.windowSize ||
+        filled != other.filled)
+        return false;
+
+    if (estimator == AsgNoiseEstimator::Rms)
+        return writePtr == other.writePtr && sum == other.sum && squares == other.squares;
+
+    // Samples skipped by the caller (e.g. peaks) shift the ring buffers against the stream position,
+    // so compare them from the oldest sample. The median cursor is determined by the histogram.
+    if (counts != other.counts)
+        return false;
+
+    size_t ptr = (writePtr + windowSize - filled) % windowSize;
+    size_t otherPtr = (other.writePtr + windowSize - filled) % windowSize;
+    for (size_t i = 0; i < filled; ++i)
+    {
+        if (bins[ptr] != other.bins[otherPtr])
+            return false;
+        if (++ptr == windowSize)
+            ptr = 0;
+        if (++otherPtr == windowSize)
+            otherPtr = 0;
+    }
+    return true;
+}
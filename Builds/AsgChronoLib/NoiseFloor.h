@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+enum class AsgNoiseEstimator
+{
+    Rms,    // RMS of the window (cheapest, but raised by loud events in the window)
+    Median  // median absolute amplitude of the window scaled to sigma (robust to outliers)
+};
+
+/**
+ * Sliding window noise floor estimator.
+ * Keeps RMS or median absolute amplitude of the last "windowSize" samples, updated in constant
+ * time per sample.
+ *
+ * The median is tracked in a histogram of amplitudes with logarithmic bins (8 per octave) and
+ * interpolated inside the bin holding it. The cursor moves by a few bins per update at most, as
+ * the noise changes slowly compared to the window.
+ *
+ * With decimation only every n-th sample of the stream is kept, which estimates the same statistic
+ * of white noise at a fraction of the cost (for high sample rates).
+ */
+class AsgNoiseFloor
+{
+    static const size_t BINS_NUM = 256;
+
+    AsgNoiseEstimator estimator;
+    size_t decimation;
+    size_t windowSize;  // in kept samples
+    size_t writePtr;
+    size_t filled;
+
+    // Rms
+    std::vector<float> squares;  // ring buffer of squared samples
+    double sum;
+
+    // Median
+    std::vector<uint8_t> bins;   // ring buffer of amplitude bins
+    std::vector<uint32_t> counts;  // histogram
+    size_t medianBin;
+    size_t belowMedian;          // samples in the bins below medianBin
+
+    void PushSquares(const float* samples, size_t samplesNum, size_t stride);
+    void PushBins(const float* samples, size_t samplesNum, size_t stride);
+
+public:
+    AsgNoiseFloor();
+
+    /**
+     * Clear the window of "windowSize" stream samples. "samplePos" is the stream position of the
+     * next pushed sample - windows of streams started at different positions become identical once
+     * they contain the same samples.
+     */
+    void Reset(size_t windowSize, uint64_t samplePos = 0, AsgNoiseEstimator estimator = AsgNoiseEstimator::Rms,
+               size_t decimation = 1);
+
+    /**
+     * Push new samples into the window (the oldest ones are dropped). "samplePos" is the stream
+     * position of the first one, it selects the samples kept when decimating.
+     */
+    void Push(const float* samples, size_t samplesNum, uint64_t samplePos);
+
+    bool IsEmpty() const;
+
+    /**
+     * Get RMS of the samples in the window (with the median estimator, the standard deviation of
+     * Gaussian noise having the same median absolute amplitude).
+     */
+    float GetRMS() const;
+
+    bool HasSameState(const AsgNoiseFloor& other) const;
+};
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "ParallelAnalyzer.h"
+#include "Trace.h"
+
+namespace {
+
+size_t RoundUp(size_t value, size_t step)
+{
+    return (value + step - 1) / step * step;
+}
+
+} // namespace
+
+AsgParallelAnalyzer::AsgParallelAnalyzer(size_t threadsNum)
+    : workerPool(new AsgWorkerPool(threadsNum))
+    , chunkSize(0)
+    , reanalyzedChunks(0)
+{
+}
+
+AsgCounterConfig& AsgParallelAnalyzer::GetConfig()
+{
+    return config;
+}
+
+void AsgParallelAnalyzer::SetChunkSize(size_t samplesNum)
+{
+    chunkSize = samplesNum;
+}
+
+size_t AsgParallelAnalyzer::GetGuardSize() const
+{
+    AsgCounter counter;
+    counter.GetConfig() = config;
+    counter.Reset();
+    const size_t blockSize = counter.GetBlockSize();
+
+    // a peaks group that started before the chunk must be complete before it
+    size_t guard = RoundUp(config.maxPeakDistance + 2 * config.minPeakDistance, blockSize);
+
+    // noise estimation warmup
+    if (config.rmsWindow > 0)
+        guard += 2 * RoundUp(config.rmsWindow, blockSize);
+    else
+        guard += (1 + GUARD_RMS_BLOCKS) * blockSize;
+
+    return guard;
+}
+
+void AsgParallelAnalyzer::Analyze(const float* samples, size_t samplesNum)
+{
+    stats.Reset(config.historySize);
+    reanalyzedChunks = 0;
+
+    // chunks keep all their shots until they are merged
+    AsgCounter prototype;
+    prototype.GetConfig() = config;
+    prototype.GetConfig().historySize = 0;
+    prototype.Reset();
+
+    // chunks must start at block boundaries of the sequential analysis
+    const size_t blockSize = prototype.GetBlockSize();
+    const size_t guard = GetGuardSize();
+
+    size_t size = chunkSize;
+    if (size == 0)
+        size = samplesNum / workerPool->GetThreadsNum();
+    size = RoundUp(std::max(size, guard), blockSize);
+
+    size_t chunksNum = std::max<size_t>((samplesNum + size - 1) / size, 1);
+    chunks.resize(chunksNum);
+    for (size_t i = 0; i < chunksNum; ++i)
+    {
+        if (!chunks[i])
+            chunks[i].reset(new Chunk);
+        chunks[i]->begin = i * size;
+        chunks[i]->end = std::min((i + 1) * size, samplesNum);
+    }
+
+    workerPool->ParallelFor(chunksNum, [&](size_t i)
+    {
+        ASG_TRACE_SCOPE("AnalyzeChunk");
+        Chunk& chunk = *chunks[i];
+        size_t guardBegin = chunk.begin - std::min(chunk.begin, guard);
+
+        chunk.counter = prototype;
+        chunk.counter.Reset(guardBegin);
+        chunk.counter.ProcessBuffer(samples + guardBegin, chunk.begin - guardBegin);
+
+        // shots completed in the guard region belong to the previous chunk
+        chunk.counter.GetStats().Reset();
+        chunk.entryState = chunk.counter;
+
+        chunk.counter.ProcessBuffer(samples + chunk.begin, chunk.end - chunk.begin);
+    });
+
+    // verify that every chunk started where the previous one ended, continue sequentially otherwise
+    for (size_t i = 1; i < chunksNum; ++i)
+    {
+        Chunk& chunk = *chunks[i];
+        const AsgCounter& prevCounter = chunks[i - 1]->counter;
+        if (chunk.entryState.HasSameState(prevCounter))
+            continue;
+
+        ASG_TRACE_SCOPE("ReanalyzeChunk");
+        chunk.counter = prevCounter;
+        chunk.counter.GetStats().Reset();
+        chunk.counter.ProcessBuffer(samples + chunk.begin, chunk.end - chunk.begin);
+        reanalyzedChunks++;
+    }
+
+    // merge the shots, intervals between chunks are calculated the same way AsgCounter does it
+    double prevPosition = -1.0;
+    for (size_t i = 0; i < chunksNum; ++i)
+    {
+        const AsgShotHistory& history = chunks[i]->counter.GetStats().history;
+        for (size_t j = 0; j < history.GetSize(); ++j)
+        {
+            const AsgStatsSample& sample = history[j];
+            float dt = -1.0f;
+            if (prevPosition > 0)
+                dt = static_cast<float>((sample.position - prevPosition) / config.sampleRate);
+            stats.AddSample(sample.velocity, dt, sample.position, config);
+            prevPosition = sample.position;
+        }
+    }
+}
+
+const AsgStats& AsgParallelAnalyzer::GetStats() const
+{
+    return stats;
+}
+
+size_t AsgParallelAnalyzer::GetReanalyzedChunksNum() const
+{
+    return reanalyzedChunks;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+
+#include "Counter.h"
+#include "WorkerPool.h"
+
+/**
+ * Offline analysis of a single long capture on multiple cores.
+ *
+ * The capture is split into chunks analyzed in parallel. Every chunk is preceded by a guard region
+ * (longer than a peaks group plus the noise estimation warmup), which brings the chunk's counter to
+ * the state the sequential counter has at the chunk's beginning. The states are verified when the
+ * results are merged and chunks entered in a different state are analyzed again, so the result is
+ * always exactly the same as of AsgCounter::ProcessBuffer() called for the whole capture at once.
+ * Note that state of the pre-filter (if enabled) does not converge bit-exactly, so such captures
+ * are effectively analyzed sequentially.
+ */
+class AsgParallelAnalyzer
+{
+    struct Chunk
+    {
+        size_t begin, end;
+        AsgCounter entryState;  // state after the guard region
+        AsgCounter counter;     // state at the end of the chunk
+    };
+
+    static const size_t GUARD_RMS_BLOCKS = 24;  // for block RMS smoothing to converge
+
+    AsgCounterConfig config;
+    AsgStats stats;
+    std::unique_ptr<AsgWorkerPool> workerPool;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    size_t chunkSize;
+    size_t reanalyzedChunks;
+
+public:
+    /**
+     * "threadsNum" - number of threads to use (0 - number of hardware threads).
+     */
+    explicit AsgParallelAnalyzer(size_t threadsNum = 0);
+
+    AsgCounterConfig& GetConfig();
+
+    /**
+     * Set chunk length in samples (rounded up to the analysis block size).
+     * 0 (default) splits the capture evenly between the threads.
+     */
+    void SetChunkSize(size_t samplesNum);
+
+    /**
+     * Minimum distance of chunk boundaries from the beginning of the guard region, in samples.
+     */
+    size_t GetGuardSize() const;
+
+    /**
+     * Analyze the whole capture.
+     */
+    void Analyze(const float* samples, size_t samplesNum);
+
+    const AsgStats& GetStats() const;
+
+    /**
+     * Number of chunks analyzed again during the last Analyze() call, because their guard region
+     * was not long enough to reproduce the sequential state.
+     */
+    size_t GetReanalyzedChunksNum() const;
+};
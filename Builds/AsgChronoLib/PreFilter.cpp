@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "PreFilter.h"
+#include "Counter.h"
+
+const float AsgPreFilter::HUM_NOTCH_Q = 10.0f;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+const double BUTTERWORTH_Q = 0.70710678118654752440;
+
+} // namespace
+
+AsgPreFilter::AsgPreFilter()
+{
+    Setup(AsgCounterConfig());
+}
+
+void AsgPreFilter::AddStage(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    Biquad stage;
+    stage.b0 = b0 / a0;
+    stage.b1 = b1 / a0;
+    stage.b2 = b2 / a0;
+    stage.a1 = a1 / a0;
+    stage.a2 = a2 / a0;
+    stage.z1 = 0.0;
+    stage.z2 = 0.0;
+    stages.push_back(stage);
+}
+
+void AsgPreFilter::Setup(const AsgCounterConfig& config)
+{
+    // biquad coefficients from Robert Bristow-Johnson's Audio EQ Cookbook
+    const double nyquist = 0.5 * config.sampleRate;
+    stages.clear();
+
+    dcBlocker = config.highPassFrequency > 0.0f && config.highPassFrequency < nyquist;
+    dcX1 = 0.0;
+    dcY1 = 0.0;
+    if (dcBlocker)
+    {
+        double w0 = 2.0 * PI * config.highPassFrequency / config.sampleRate;
+        double alpha = sin(w0) / (2.0 * BUTTERWORTH_Q);
+        double cosw0 = cos(w0);
+        AddStage((1.0 + cosw0) / 2.0, -(1.0 + cosw0), (1.0 + cosw0) / 2.0, 1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+
+        // together with the DC blocker it's 3rd order high-pass (18 dB per octave)
+        dcPole = exp(-w0);
+    }
+
+    for (int i = 1; i <= HUM_HARMONICS && config.humFrequency > 0.0f; ++i)
+    {
+        double frequency = config.humFrequency * i;
+        if (frequency >= nyquist)
+            break;
+
+        double w0 = 2.0 * PI * frequency / config.sampleRate;
+        double alpha = sin(w0) / (2.0 * HUM_NOTCH_Q);
+        double cosw0 = cos(w0);
+        AddStage(1.0, -2.0 * cosw0, 1.0, 1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+
+    if (config.lowPassFrequency > 0.0f && config.lowPassFrequency < nyquist)
+    {
+        double w0 = 2.0 * PI * config.lowPassFrequency / config.sampleRate;
+        double alpha = sin(w0) / (2.0 * BUTTERWORTH_Q);
+        double cosw0 = cos(w0);
+        AddStage((1.0 - cosw0) / 2.0, 1.0 - cosw0, (1.0 - cosw0) / 2.0, 1.0 + alpha, -2.0 * cosw0, 1.0 - alpha);
+    }
+
+    enabled = dcBlocker || !stages.empty();
+}
+
+bool AsgPreFilter::IsEnabled() const
+{
+    return enabled;
+}
+
+void AsgPreFilter::Process(const float* input, float* output, size_t samplesNum)
+{
+    if (dcBlocker)
+    {
+        double x1 = dcX1;
+        double y1 = dcY1;
+        for (size_t i = 0; i < samplesNum; ++i)
+        {
+            double x = input[i];
+            y1 = x - x1 + dcPole * y1;
+            x1 = x;
+            output[i] = static_cast<float>(y1);
+        }
+        dcX1 = x1;
+        dcY1 = y1;
+    }
+    else
+        memcpy(output, input, samplesNum * sizeof(float));
+
+    // all stages for every sample - the stages of the successive samples are independent, so
+    // the CPU overlaps their dependency chains
+    const size_t stagesNum = stages.size();
+    double z1[MAX_STAGES], z2[MAX_STAGES];
+    for (size_t s = 0; s < stagesNum; ++s)
+    {
+        z1[s] = stages[s].z1;
+        z2[s] = stages[s].z2;
+    }
+
+    for (size_t i = 0; i < samplesNum; ++i)
+    {
+        double x = output[i];
+        for (size_t s = 0; s < stagesNum; ++s)
+        {
+            const Biquad& stage = stages[s];
+            double y = stage.b0 * x + z1[s];
+            z1[s] = stage.b1 * x - stage.a1 * y + z2[s];
+            z2[s] = stage.b2 * x - stage.a2 * y;
+            x = y;
+        }
+        output[i] = static_cast<float>(x);
+    }
+
+    for (size_t s = 0; s < stagesNum; ++s)
+    {
+        stages[s].z1 = z1[s];
+        stages[s].z2 = z2[s];
+    }
+}
+
+bool AsgPreFilter::HasSameState(const AsgPreFilter& other) const
+{
+    if (enabled != other.enabled || dcX1 != other.dcX1 || dcY1 != other.dcY1 || stages.size() != other.stages.size())
+        return false;
+
+    for (size_t s = 0; s < stages.size(); ++s)
+    {
+        if (stages[s].z1 != other.stages[s].z1 || stages[s].z2 != other.stages[s].z2)
+            return false;
+    }
+    return true;
+}
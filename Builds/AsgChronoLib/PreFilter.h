@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+struct AsgCounterConfig;
+
+/**
+ * Filter applied to the samples before detection: DC blocker and cascade of biquads
+ * (high-pass against low-frequency drift, notches against mains hum, low-pass).
+ * Whole blocks are filtered in a single pass (IIR recursion can't be vectorized over time, but the
+ * stages of successive samples are independent and overlap in the CPU pipeline).
+ */
+class AsgPreFilter
+{
+    struct Biquad
+    {
+        double b0, b1, b2, a1, a2;
+        double z1, z2;  // transposed direct form II state
+    };
+
+    static const int HUM_HARMONICS = 3;
+    static const size_t MAX_STAGES = 8;  // high-pass, hum notches and low-pass
+    static const float HUM_NOTCH_Q;
+
+    bool enabled;
+
+    // DC blocker: y[n] = x[n] - x[n - 1] + pole * y[n - 1]
+    bool dcBlocker;
+    double dcPole;
+    double dcX1, dcY1;
+
+    std::vector<Biquad> stages;
+
+    void AddStage(double b0, double b1, double b2, double a0, double a1, double a2);
+
+public:
+    AsgPreFilter();
+
+    /**
+     * Design filters for the config (sampleRate, highPassFrequency, humFrequency, lowPassFrequency)
+     * and clear their state.
+     */
+    void Setup(const AsgCounterConfig& config);
+
+    bool IsEnabled() const;
+
+    /**
+     * Filter "samplesNum" samples from "input" to "output".
+     */
+    void Process(const float* input, float* output, size_t samplesNum);
+
+    bool HasSameState(const AsgPreFilter& other) const;
+};
@@ -0,0 +1,224 @@
+#include "stdafx.h"
+#include "QuantileSketch.h"
+
+const uint32_t AsgQuantileSketch::K;
+const uint32_t AsgQuantileSketch::MIN_LEVEL_CAPACITY;
+const uint32_t AsgQuantileSketch::MAX_LEVELS;
+const uint32_t AsgQuantileSketch::ITEMS_CAPACITY;
+
+namespace {
+
+const double LEVEL_CAPACITY_RATIO = 2.0 / 3.0;
+const uint32_t RANDOM_SEED = 0x9E3779B9u;
+
+struct WeightedItem
+{
+    float value;
+    uint64_t weight;
+};
+
+} // namespace
+
+AsgQuantileSketch::AsgQuantileSketch()
+{
+    Reset();
+}
+
+void AsgQuantileSketch::Reset()
+{
+    levelsNum = 1;
+    levels[0] = ITEMS_CAPACITY;
+    levels[1] = ITEMS_CAPACITY;
+    capacity = GetLevelCapacity(0, levelsNum);
+    count = 0;
+    minValue = FLT_MAX;
+    maxValue = -FLT_MAX;
+    random = RANDOM_SEED;
+}
+
+uint32_t AsgQuantileSketch::GetLevelCapacity(uint32_t level, uint32_t levelsNum)
+{
+    // by the depth below the top level
+    struct CapacityTable
+    {
+        uint32_t capacities[MAX_LEVELS];
+
+        CapacityTable()
+        {
+            for (uint32_t depth = 0; depth < MAX_LEVELS; ++depth)
+            {
+                double capacity = ceil(K * pow(LEVEL_CAPACITY_RATIO, static_cast<double>(depth)));
+                capacities[depth] = std::max(static_cast<uint32_t>(capacity), static_cast<uint32_t>(MIN_LEVEL_CAPACITY));
+            }
+        }
+    };
+    static const CapacityTable table;
+
+    return table.capacities[levelsNum - 1 - level];
+}
+
+bool AsgQuantileSketch::Compress()
+{
+    // compact the lowest level over its capacity (there is one, as the sketch is full)
+    uint32_t level = 0;
+    while (level + 1 < levelsNum && levels[level + 1] - levels[level] < GetLevelCapacity(level, levelsNum))
+        level++;
+
+    if (level + 1 == levelsNum)
+    {
+        if (levelsNum == MAX_LEVELS)
+            return false;
+
+        levelsNum++;
+        levels[levelsNum] = ITEMS_CAPACITY;
+        capacity = 0;
+        for (uint32_t i = 0; i < levelsNum; ++i)
+            capacity += GetLevelCapacity(i, levelsNum);
+    }
+
+    const uint32_t begin = levels[level];
+    const uint32_t end = levels[level + 1];
+    std::sort(items + begin, items + end);
+
+    // odd item stays on the level, the kept half moves next to the level above
+    const uint32_t odd = (end - begin) & 1;
+    const uint32_t half = (end - begin - odd) / 2;
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    const uint32_t offset = random & 1;
+
+    float* compacted = items + begin + odd;
+    for (uint32_t i = half; i-- > 0;)
+        compacted[half + i] = compacted[2 * i + offset];
+
+    memmove(items + levels[0] + half, items + levels[0], (begin + odd - levels[0]) * sizeof(float));
+    for (uint32_t i = 0; i <= level; ++i)
+        levels[i] += half;
+    levels[level + 1] = end - half;
+    return true;
+}
+
+bool AsgQuantileSketch::Insert(uint32_t level, float value)
+{
+    while (ITEMS_CAPACITY - levels[0] >= capacity)
+    {
+        if (!Compress())
+            return false;
+    }
+
+    // make room at the beginning of the level
+    const uint32_t pos = levels[level] - 1;
+    memmove(items + levels[0] - 1, items + levels[0], (levels[level] - levels[0]) * sizeof(float));
+    for (uint32_t i = 0; i <= level; ++i)
+        levels[i]--;
+    items[pos] = value;
+    return true;
+}
+
+void AsgQuantileSketch::Add(float value)
+{
+    if (value != value)
+        return;  // NaN
+
+    if (!Insert(0, value))
+        return;
+
+    count++;
+    minValue = std::min(minValue, value);
+    maxValue = std::max(maxValue, value);
+}
+
+void AsgQuantileSketch::Merge(const AsgQuantileSketch& other)
+{
+    // items keep their weight (level), lower levels first so that compaction has the most to choose from
+    for (uint32_t level = 0; level < other.levelsNum; ++level)
+    {
+        while (levelsNum <= level)
+        {
+            levelsNum++;
+            levels[levelsNum] = ITEMS_CAPACITY;
+        }
+        capacity = 0;
+        for (uint32_t i = 0; i < levelsNum; ++i)
+            capacity += GetLevelCapacity(i, levelsNum);
+
+        for (uint32_t i = other.levels[level]; i < other.levels[level + 1]; ++i)
+        {
+            if (!Insert(level, other.items[i]))
+                return;
+            count += uint64_t(1) << level;
+        }
+    }
+
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+uint64_t AsgQuantileSketch::GetCount() const
+{
+    return count;
+}
+
+float AsgQuantileSketch::GetQuantile(float fraction) const
+{
+    float quantile;
+    GetQuantiles(&fraction, &quantile, 1);
+    return quantile;
+}
+
+void AsgQuantileSketch::GetQuantiles(const float* fractions, float* quantiles, size_t num) const
+{
+    // sorted items with the cumulative weight up to them
+    WeightedItem weighted[ITEMS_CAPACITY];
+    const uint32_t itemsNum = ITEMS_CAPACITY - levels[0];
+    for (uint32_t level = 0; level < levelsNum; ++level)
+    {
+        for (uint32_t i = levels[level]; i < levels[level + 1]; ++i)
+        {
+            weighted[i - levels[0]].value = items[i];
+            weighted[i - levels[0]].weight = uint64_t(1) << level;
+        }
+    }
+    std::sort(weighted, weighted + itemsNum,
+              [](const WeightedItem& a, const WeightedItem& b) { return a.value < b.value; });
+    for (uint32_t i = 1; i < itemsNum; ++i)
+        weighted[i].weight += weighted[i - 1].weight;
+
+    for (size_t j = 0; j < num; ++j)
+    {
+        if (count == 0)
+            quantiles[j] = -1.0f;
+        else if (fractions[j] <= 0.0f)
+            quantiles[j] = minValue;
+        else if (fractions[j] >= 1.0f)
+            quantiles[j] = maxValue;
+        else
+        {
+            // first item reaching the rank
+            const double rank = static_cast<double>(fractions[j]) * static_cast<double>(count);
+            const WeightedItem* item = std::lower_bound(weighted, weighted + itemsNum, rank,
+                [](const WeightedItem& a, double rank) { return static_cast<double>(a.weight) < rank; });
+            quantiles[j] = item != weighted + itemsNum ? item->value : maxValue;
+        }
+    }
+}
+
+uint64_t AsgQuantileSketch::GetRank(float value) const
+{
+    uint64_t rank = 0;
+    for (uint32_t level = 0; level < levelsNum; ++level)
+    {
+        for (uint32_t i = levels[level]; i < levels[level + 1]; ++i)
+        {
+            if (items[i] <= value)
+                rank += uint64_t(1) << level;
+        }
+    }
+    return rank;
+}
+
+uint64_t AsgQuantileSketch::CountAbove(float value) const
+{
+    return count - GetRank(value);
+}
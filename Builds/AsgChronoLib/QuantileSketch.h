@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Streaming quantile sketch (KLL) with fixed storage, so it's copied without allocations (e.g. in
+ * a snapshot published to the GUI) and the memory does not grow with the number of values.
+ *
+ * Values are kept in levels of compactors, an item on level h stands for 2^h values. When the
+ * sketch is full, the lowest level over its capacity is sorted and every other item (starting at
+ * a random one) is moved to the next level. Level capacities shrink by 2/3 going down from the top
+ * one, so the sketch keeps about 3K items and ranks are estimated within about 1% of the number of
+ * values. Up to K values are kept exactly. Sketches of separate streams can be merged.
+ */
+class AsgQuantileSketch
+{
+public:
+    static const uint32_t K = 200;  // capacity of the top level
+
+private:
+    static const uint32_t MIN_LEVEL_CAPACITY = 8;
+    static const uint32_t MAX_LEVELS = 40;  // over 10^14 values
+    static const uint32_t ITEMS_CAPACITY = 1024;  // at least the capacity of MAX_LEVELS levels
+
+    // level h occupies items[levels[h], levels[h + 1]), free space is before level 0
+    float items[ITEMS_CAPACITY];
+    uint32_t levels[MAX_LEVELS + 1];
+    uint32_t levelsNum;
+    uint32_t capacity;  // of all the levels
+    uint64_t count;
+    float minValue, maxValue;
+    uint32_t random;  // xorshift state, the same sequence after every Reset()
+
+    static uint32_t GetLevelCapacity(uint32_t level, uint32_t levelsNum);
+    bool Insert(uint32_t level, float value);
+    bool Compress();
+
+public:
+    AsgQuantileSketch();
+
+    void Reset();
+    void Add(float value);
+
+    /**
+     * Add values of another sketch (e.g. of another channel).
+     */
+    void Merge(const AsgQuantileSketch& other);
+
+    /**
+     * Number of the added values.
+     */
+    uint64_t GetCount() const;
+
+    /**
+     * Estimated value with the given fraction (0 - 1) of the values below it, -1 if empty.
+     */
+    float GetQuantile(float fraction) const;
+
+    /**
+     * Estimated values of several fractions at once, the items are sorted only once. Doesn't
+     * allocate (the items are sorted on the stack).
+     */
+    void GetQuantiles(const float* fractions, float* quantiles, size_t num) const;
+
+    /**
+     * Estimated number of the values less than or equal to "value".
+     */
+    uint64_t GetRank(float value) const;
+
+    /**
+     * Estimated number of the values greater than "value".
+     */
+    uint64_t CountAbove(float value) const;
+};
@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include "ShotHistory.h"
+
+AsgShotHistory::AsgShotHistory()
+{
+    Reset(0);
+}
+
+void AsgShotHistory::Reset(size_t capacity)
+{
+    this->capacity = capacity;
+    if (capacity > 0)
+        samples.resize(capacity);
+    else
+        samples.clear();
+
+    first = 0;
+    size = 0;
+    droppedNum = 0;
+}
+
+void AsgShotHistory::Add(const AsgStatsSample& sample)
+{
+    if (capacity == 0)
+    {
+        samples.push_back(sample);
+        size++;
+        return;
+    }
+
+    if (size < capacity)
+    {
+        size_t i = first + size;
+        samples[i < capacity ? i : i - capacity] = sample;
+        size++;
+        return;
+    }
+
+    // full - replace the oldest shot
+    if (spillCallback)
+        spillCallback(droppedNum, samples[first]);
+    samples[first] = sample;
+    if (++first == capacity)
+        first = 0;
+    droppedNum++;
+}
+
+void AsgShotHistory::SetCapacity(size_t newCapacity)
+{
+    std::vector<AsgStatsSample> kept;
+    CopyTo(kept);
+
+    size_t spilledNum = 0;
+    if (newCapacity > 0 && kept.size() > newCapacity)
+        spilledNum = kept.size() - newCapacity;
+    if (spillCallback)
+    {
+        for (size_t i = 0; i < spilledNum; ++i)
+            spillCallback(droppedNum + i, kept[i]);
+    }
+
+    const uint64_t dropped = droppedNum + spilledNum;
+    Reset(newCapacity);
+    for (size_t i = spilledNum; i < kept.size(); ++i)
+        Add(kept[i]);
+    droppedNum = dropped;
+}
+
+size_t AsgShotHistory::GetCapacity() const
+{
+    return capacity;
+}
+
+size_t AsgShotHistory::GetSize() const
+{
+    return size;
+}
+
+uint64_t AsgShotHistory::GetDroppedNum() const
+{
+    return droppedNum;
+}
+
+const AsgStatsSample& AsgShotHistory::operator[](size_t i) const
+{
+    i += first;
+    return samples[i < samples.size() ? i : i - samples.size()];
+}
+
+void AsgShotHistory::CopyTo(std::vector<AsgStatsSample>& shots) const
+{
+    shots.resize(size);
+    for (size_t i = 0; i < size; ++i)
+        shots[i] = (*this)[i];
+}
+
+void AsgShotHistory::SetSpillCallback(AsgHistorySpillCallback callback)
+{
+    spillCallback = callback;
+}
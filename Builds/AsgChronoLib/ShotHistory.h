@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+struct AsgStatsSample
+{
+    float velocity;
+    float deltaTime;
+    double position;  // first peak position (in samples since the beginning of the stream)
+};
+
+// "index" is the shot number since Reset()
+typedef std::function<void(uint64_t index, const AsgStatsSample& sample)> AsgHistorySpillCallback;
+
+/**
+ * History of the recent shots. With a limited capacity, the memory is allocated in Reset() only and
+ * the oldest shot is dropped (passed to the spill callback, e.g. for writing it to disk) when a new
+ * one doesn't fit.
+ */
+class AsgShotHistory
+{
+    std::vector<AsgStatsSample> samples;
+    size_t capacity;  // 0 - unlimited
+    size_t first;     // index of the oldest shot in samples
+    size_t size;
+    uint64_t droppedNum;
+    AsgHistorySpillCallback spillCallback;
+
+public:
+    AsgShotHistory();
+
+    /**
+     * Drop all the shots (without spilling them) and set the capacity (0 - unlimited).
+     */
+    void Reset(size_t capacity);
+
+    void Add(const AsgStatsSample& sample);
+
+    /**
+     * Change the capacity keeping the newest shots, the ones which don't fit are spilled.
+     */
+    void SetCapacity(size_t capacity);
+
+    size_t GetCapacity() const;
+
+    /**
+     * Number of the kept shots.
+     */
+    size_t GetSize() const;
+
+    /**
+     * Number of the shots dropped since Reset() (also the index of the oldest kept shot).
+     */
+    uint64_t GetDroppedNum() const;
+
+    /**
+     * Get kept shot, 0 is the oldest one.
+     */
+    const AsgStatsSample& operator[](size_t i) const;
+
+    /**
+     * Copy the kept shots from the oldest one.
+     */
+    void CopyTo(std::vector<AsgStatsSample>& shots) const;
+
+    /**
+     * Set callback called with every dropped shot (before the next one is added).
+     */
+    void SetSpillCallback(AsgHistorySpillCallback callback);
+};
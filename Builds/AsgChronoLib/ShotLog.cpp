@@ -0,0 +1,495 @@
+#include "stdafx.h"
+#include "ShotLog.h"
+#include "ByteStream.h"
+
+#include <ctime>
+
+namespace {
+
+const uint32_t LOG_MAGIC = 0x4C475341;    // "ASGL"
+const uint32_t BLOCK_MAGIC = 0x42475341;  // "ASGB"
+const uint16_t LOG_VERSION = 1;
+
+const size_t BLOCK_HEADER_SIZE = 32;
+const uint32_t BLOCK_SHOTS = 256;
+const size_t MAX_SHOT_SIZE = 10 + 2;  // varint and velocity
+
+const double POSITION_SCALE = 256.0;
+const float VELOCITY_SCALE = 100.0f;
+
+const int POLL_INTERVAL_MS = 20;
+const int FLUSH_INTERVAL_MS = 1000;  // partially filled block is written after this time
+
+int64_t QuantizePosition(double position)
+{
+    return static_cast<int64_t>(floor(position * POSITION_SCALE + 0.5));
+}
+
+uint16_t QuantizeVelocity(float velocity)
+{
+    if (!(velocity > 0.0f))
+        return 0;
+    float scaled = floorf(velocity * VELOCITY_SCALE + 0.5f);
+    return static_cast<uint16_t>(std::min(std::max(scaled, 1.0f), 65535.0f));
+}
+
+float DequantizeVelocity(uint16_t velocity)
+{
+    return velocity > 0 ? velocity / VELOCITY_SCALE : -1.0f;
+}
+
+void EncodeConfig(std::vector<uint8_t>& buffer, const AsgCounterConfig& config)
+{
+    AsgPutU64(buffer, config.minPeakDistance);
+    AsgPutU64(buffer, config.maxPeakDistance);
+    AsgPutFloat(buffer, config.sampleRate);
+    AsgPutFloat(buffer, config.length);
+    AsgPutFloat(buffer, config.mass);
+    AsgPutFloat(buffer, config.detectionSigma);
+    AsgPutFloat(buffer, config.fireRateTreshold);
+    AsgPutU64(buffer, config.blockSize);
+    AsgPutU64(buffer, config.rmsWindow);
+    AsgPutU8(buffer, static_cast<uint8_t>(config.noiseEstimator));
+    AsgPutU64(buffer, config.decimation);
+    AsgPutU8(buffer, static_cast<uint8_t>(config.peakEstimator));
+    AsgPutFloat(buffer, config.highPassFrequency);
+    AsgPutFloat(buffer, config.humFrequency);
+    AsgPutFloat(buffer, config.lowPassFrequency);
+    AsgPutU64(buffer, config.historySize);
+}
+
+void DecodeConfig(AsgByteReader& decoder, AsgCounterConfig& config)
+{
+    config.minPeakDistance = static_cast<size_t>(decoder.GetU64());
+    config.maxPeakDistance = static_cast<size_t>(decoder.GetU64());
+    config.sampleRate = decoder.GetFloat();
+    config.length = decoder.GetFloat();
+    config.mass = decoder.GetFloat();
+    config.detectionSigma = decoder.GetFloat();
+    config.fireRateTreshold = decoder.GetFloat();
+    config.blockSize = static_cast<size_t>(decoder.GetU64());
+    config.rmsWindow = static_cast<size_t>(decoder.GetU64());
+    config.noiseEstimator = static_cast<AsgNoiseEstimator>(decoder.GetU8());
+    config.decimation = static_cast<size_t>(decoder.GetU64());
+    config.peakEstimator = static_cast<AsgPeakEstimator>(decoder.GetU8());
+    config.highPassFrequency = decoder.GetFloat();
+    config.humFrequency = decoder.GetFloat();
+    config.lowPassFrequency = decoder.GetFloat();
+    config.historySize = static_cast<size_t>(decoder.GetU64());
+}
+
+// the log keeps the position and velocity only
+AsgShotEvent MakeShotEvent(uint64_t index, const AsgStatsSample& sample)
+{
+    AsgShotEvent event = AsgShotEvent();
+    event.index = index;
+    event.firstPeak = sample.position;
+    event.secondPeak = -1.0;
+    event.velocity = sample.velocity;
+    event.deltaTime = sample.deltaTime;
+    return event;
+}
+
+} // namespace
+
+// AsgShotLogWriter ====
+
+AsgShotLogWriter::AsgShotLogWriter(size_t queueCapacity)
+    : queue(queueCapacity)
+    , droppedNum(0)
+    , failed(false)
+    , stopRequested(false)
+    , opened(false)
+    , finalFirstIndex(0)
+    , file(nullptr)
+{
+}
+
+AsgShotLogWriter::~AsgShotLogWriter()
+{
+    Close();
+}
+
+bool AsgShotLogWriter::Open(const char* path, const AsgCounterConfig& config)
+{
+    Close();
+
+    file = fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    std::vector<uint8_t> header;
+    AsgPutU32(header, LOG_MAGIC);
+    AsgPutU16(header, LOG_VERSION);
+    AsgPutU16(header, 0);  // size, filled below
+    AsgPutU64(header, static_cast<uint64_t>(time(nullptr)));
+    EncodeConfig(header, config);
+    header[6] = static_cast<uint8_t>(header.size());
+    header[7] = static_cast<uint8_t>(header.size() >> 8);
+
+    if (fwrite(header.data(), 1, header.size(), file) != header.size() || fflush(file) != 0)
+    {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    block.clear();
+    block.reserve(BLOCK_HEADER_SIZE + BLOCK_SHOTS * MAX_SHOT_SIZE);
+    blockShotsNum = 0;
+    nextIndex = 0;
+    prevPosition = 0;
+
+    AsgShotEvent event;
+    while (queue.Pop(event))
+        ;  // shots pushed before opening belong to no session
+    droppedNum = 0;
+    failed = false;
+    stopRequested = false;
+    finalShots.clear();
+    opened = true;
+    thread = std::thread(&AsgShotLogWriter::WriterMain, this);
+    return true;
+}
+
+void AsgShotLogWriter::Close()
+{
+    if (!thread.joinable())
+        return;
+
+    stopRequested.store(true, std::memory_order_release);
+    thread.join();
+    opened = false;
+}
+
+void AsgShotLogWriter::Finish(const AsgShotHistory& history, uint64_t firstIndex)
+{
+    if (!opened)
+        return;
+
+    const uint64_t historyFirstIndex = history.GetDroppedNum();
+    const uint64_t historyEndIndex = historyFirstIndex + history.GetSize();
+    finalFirstIndex = std::min(std::max(firstIndex, historyFirstIndex), historyEndIndex);
+    finalShots.resize(static_cast<size_t>(historyEndIndex - finalFirstIndex));
+    for (size_t i = 0; i < finalShots.size(); ++i)
+        finalShots[i] = history[static_cast<size_t>(finalFirstIndex - historyFirstIndex) + i];
+
+    // the writer thread sees the final shots once it sees the stop request
+    opened = false;
+    stopRequested.store(true, std::memory_order_release);
+}
+
+bool AsgShotLogWriter::IsOpen() const
+{
+    return opened;
+}
+
+bool AsgShotLogWriter::Push(const AsgShotEvent& event)
+{
+    if (failed.load(std::memory_order_relaxed) || !queue.Push(event))
+    {
+        droppedNum.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool AsgShotLogWriter::Push(uint64_t index, const AsgStatsSample& sample)
+{
+    return Push(MakeShotEvent(index, sample));
+}
+
+void AsgShotLogWriter::PushHistory(const AsgShotHistory& history)
+{
+    if (!opened)
+        return;
+
+    const uint64_t firstIndex = history.GetDroppedNum();
+    for (size_t i = 0; i < history.GetSize(); ++i)
+    {
+        const AsgShotEvent event = MakeShotEvent(firstIndex + i, history[i]);
+        while (!failed.load(std::memory_order_relaxed) && !queue.Push(event))
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+        if (failed.load(std::memory_order_relaxed))
+            droppedNum.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint64_t AsgShotLogWriter::GetDroppedNum() const
+{
+    return droppedNum.load(std::memory_order_relaxed);
+}
+
+bool AsgShotLogWriter::HasFailed() const
+{
+    return failed.load(std::memory_order_relaxed);
+}
+
+void AsgShotLogWriter::WriterMain()
+{
+    const size_t BATCH_SIZE = 64;
+    AsgShotEvent events[BATCH_SIZE];
+
+    for (;;)
+    {
+        // shots pushed before Close() must be written
+        const bool stopping = stopRequested.load(std::memory_order_acquire);
+
+        size_t eventsNum;
+        while ((eventsNum = queue.Pop(events, BATCH_SIZE)) > 0)
+        {
+            for (size_t i = 0; i < eventsNum; ++i)
+                AddShot(events[i]);
+        }
+
+        if (stopping)
+        {
+            for (size_t i = 0; i < finalShots.size(); ++i)
+                AddShot(MakeShotEvent(finalFirstIndex + i, finalShots[i]));
+        }
+
+        if (blockShotsNum > 0 &&
+            (stopping || std::chrono::steady_clock::now() - blockStartTime >=
+                             std::chrono::milliseconds(FLUSH_INTERVAL_MS)))
+            WriteBlock();
+
+        if (stopping)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+    }
+
+    fclose(file);
+    file = nullptr;
+}
+
+void AsgShotLogWriter::AddShot(const AsgShotEvent& event)
+{
+    if (failed.load(std::memory_order_relaxed))
+    {
+        droppedNum.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // shot indexes are consecutive within a block, the interval across a gap is unknown
+    if (event.index != nextIndex)
+    {
+        if (blockShotsNum > 0)
+            WriteBlock();
+        prevPosition = 0;
+    }
+
+    if (blockShotsNum == 0)
+    {
+        block.resize(BLOCK_HEADER_SIZE);
+        blockFirstIndex = event.index;
+        blockPrevPosition = prevPosition;
+        blockMinVelocity = UINT16_MAX;
+        blockMaxVelocity = 0;
+        blockStartTime = std::chrono::steady_clock::now();
+    }
+
+    const int64_t position = QuantizePosition(event.firstPeak);
+    const uint16_t velocity = QuantizeVelocity(event.velocity);
+    AsgPutVarInt(block, position - prevPosition);
+    AsgPutU16(block, velocity);
+
+    blockMinVelocity = std::min(blockMinVelocity, velocity);
+    blockMaxVelocity = std::max(blockMaxVelocity, velocity);
+    blockShotsNum++;
+    nextIndex = event.index + 1;
+    prevPosition = position;
+
+    if (blockShotsNum == BLOCK_SHOTS)
+        WriteBlock();
+}
+
+void AsgShotLogWriter::WriteBlock()
+{
+    std::vector<uint8_t> header;
+    header.reserve(BLOCK_HEADER_SIZE);
+    AsgPutU32(header, BLOCK_MAGIC);
+    AsgPutU32(header, blockShotsNum);
+    AsgPutU32(header, static_cast<uint32_t>(block.size() - BLOCK_HEADER_SIZE));
+    AsgPutU16(header, blockMinVelocity);
+    AsgPutU16(header, blockMaxVelocity);
+    AsgPutU64(header, blockFirstIndex);
+    AsgPutU64(header, static_cast<uint64_t>(blockPrevPosition));
+    std::copy(header.begin(), header.end(), block.begin());
+
+    // the whole block at once, so a crash leaves at most the last block incomplete
+    if (fwrite(block.data(), 1, block.size(), file) != block.size() || fflush(file) != 0)
+    {
+        droppedNum.fetch_add(blockShotsNum, std::memory_order_relaxed);
+        failed.store(true, std::memory_order_relaxed);
+    }
+
+    blockShotsNum = 0;
+}
+
+// AsgShotLogReader ====
+
+AsgShotLogReader::AsgShotLogReader()
+    : file(nullptr)
+    , startTime(0)
+{
+}
+
+AsgShotLogReader::~AsgShotLogReader()
+{
+    Close();
+}
+
+bool AsgShotLogReader::Open(const char* path)
+{
+    Close();
+
+    file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    const uint64_t fileSize = AsgGetFileSize(file);
+
+    // header
+    std::vector<uint8_t> buffer;
+    if (!AsgReadBytes(file, 0, 8, buffer))
+    {
+        Close();
+        return false;
+    }
+
+    AsgByteReader prefix(buffer.data(), buffer.size());
+    const uint32_t magic = prefix.GetU32();
+    const uint16_t version = prefix.GetU16();
+    const uint16_t headerSize = prefix.GetU16();
+    if (magic != LOG_MAGIC || version > LOG_VERSION || headerSize < 8 || !AsgReadBytes(file, 0, headerSize, buffer))
+    {
+        Close();
+        return false;
+    }
+
+    AsgByteReader header(buffer.data() + 8, buffer.size() - 8);
+    startTime = static_cast<int64_t>(header.GetU64());
+    DecodeConfig(header, config);
+    if (!header.IsOk())
+    {
+        Close();
+        return false;
+    }
+
+    // index of the complete blocks
+    uint64_t offset = headerSize;
+    while (offset + BLOCK_HEADER_SIZE <= fileSize && AsgReadBytes(file, offset, BLOCK_HEADER_SIZE, buffer))
+    {
+        AsgByteReader decoder(buffer.data(), buffer.size());
+        if (decoder.GetU32() != BLOCK_MAGIC)
+            break;
+
+        BlockInfo block;
+        block.shotsNum = decoder.GetU32();
+        block.payloadSize = decoder.GetU32();
+        block.minVelocity = DequantizeVelocity(decoder.GetU16());
+        block.maxVelocity = DequantizeVelocity(decoder.GetU16());
+        block.firstIndex = decoder.GetU64();
+        block.prevPosition = static_cast<int64_t>(decoder.GetU64());
+        block.offset = offset + BLOCK_HEADER_SIZE;
+
+        if (block.offset + block.payloadSize > fileSize)
+            break;
+        if (!blocks.empty() && block.firstIndex < blocks.back().firstIndex + blocks.back().shotsNum)
+            break;
+
+        blocks.push_back(block);
+        offset = block.offset + block.payloadSize;
+    }
+
+    return true;
+}
+
+void AsgShotLogReader::Close()
+{
+    if (file != nullptr)
+        fclose(file);
+    file = nullptr;
+
+    config = AsgCounterConfig();
+    startTime = 0;
+    blocks.clear();
+}
+
+const AsgCounterConfig& AsgShotLogReader::GetConfig() const
+{
+    return config;
+}
+
+int64_t AsgShotLogReader::GetStartTime() const
+{
+    return startTime;
+}
+
+uint64_t AsgShotLogReader::GetShotsNum() const
+{
+    return blocks.empty() ? 0 : blocks.back().firstIndex + blocks.back().shotsNum;
+}
+
+bool AsgShotLogReader::ReadShots(uint64_t first, uint64_t count, std::vector<AsgLoggedShot>& shots,
+                                 float minVelocity, float maxVelocity)
+{
+    if (file == nullptr)
+        return false;
+
+    const uint64_t end = first + std::min(count, UINT64_MAX - first);
+
+    // the last block starting at or before the first requested shot
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), first,
+                               [](uint64_t index, const BlockInfo& block) { return index < block.firstIndex; });
+    if (it != blocks.begin())
+        --it;
+
+    for (; it != blocks.end() && it->firstIndex < end; ++it)
+    {
+        if (it->firstIndex + it->shotsNum <= first)
+            continue;
+        if (it->maxVelocity < minVelocity || it->minVelocity > maxVelocity)
+            continue;
+
+        if (!ReadBlock(*it, first, end, minVelocity, maxVelocity, shots))
+            return false;
+    }
+
+    return true;
+}
+
+bool AsgShotLogReader::ReadBlock(const BlockInfo& block, uint64_t first, uint64_t end, float minVelocity,
+                                 float maxVelocity, std::vector<AsgLoggedShot>& shots)
+{
+    if (!AsgReadBytes(file, block.offset, block.payloadSize, payload))
+        return false;
+
+    AsgByteReader decoder(payload.data(), payload.size());
+    int64_t prevPosition = block.prevPosition;
+    for (uint32_t i = 0; i < block.shotsNum; ++i)
+    {
+        const int64_t position = prevPosition + decoder.GetVarInt();
+        const float velocity = DequantizeVelocity(decoder.GetU16());
+        if (!decoder.IsOk())
+            return false;
+
+        const uint64_t index = block.firstIndex + i;
+        if (index >= first && index < end && velocity >= minVelocity && velocity <= maxVelocity)
+        {
+            AsgLoggedShot shot;
+            shot.index = index;
+            shot.sample.velocity = velocity;
+            shot.sample.position = position / POSITION_SCALE;
+            shot.sample.deltaTime = -1.0f;
+            if (prevPosition > 0)
+                shot.sample.deltaTime = static_cast<float>((position - prevPosition) / POSITION_SCALE / config.sampleRate);
+            shots.push_back(shot);
+        }
+
+        prevPosition = position;
+    }
+
+    return true;
+}
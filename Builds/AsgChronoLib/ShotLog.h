@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stdio.h>
+#include <float.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "Counter.h"
+#include "ShotHistory.h"
+#include "SpscRing.h"
+
+/*
+ * Shot log - compact append-only binary file with the shots of one session (all values little endian):
+ *
+ *   header:  "ASGL", uint16 version, uint16 header size, int64 session start (unix time),
+ *            AsgCounterConfig used for the session
+ *   blocks:  "ASGB", uint32 shots, uint32 payload size, uint16 min velocity, uint16 max velocity,
+ *            uint64 first shot index, int64 position of the shot before the block,
+ *            payload: per shot zigzag varint position delta and uint16 velocity
+ *
+ * Positions are fixed point (1/256 of a sample), velocities are in cm/s (0 - not measured).
+ * Shot indexes are consecutive within a block. A block is complete once written, so a log cut off
+ * by a crash is readable up to the last complete block.
+ */
+
+struct AsgLoggedShot
+{
+    uint64_t index;  // shot number in the session
+    AsgStatsSample sample;
+};
+
+/**
+ * Writes shot events to a log. Push() is meant for the detector thread - it never blocks and never
+ * touches the file, the shots are encoded and written by a background thread.
+ */
+class AsgShotLogWriter
+{
+public:
+    static const size_t DEFAULT_QUEUE_CAPACITY = 4096;
+
+private:
+    AsgSpscRing<AsgShotEvent> queue;
+    std::atomic<uint64_t> droppedNum;
+    std::atomic<bool> failed;
+    std::atomic<bool> stopRequested;
+    std::thread thread;
+    bool opened;  // false after Close() or Finish()
+
+    // shots kept in the history at Finish(), written after the queued ones
+    std::vector<AsgStatsSample> finalShots;
+    uint64_t finalFirstIndex;
+
+    // writer thread only
+    FILE* file;
+    std::vector<uint8_t> block;  // payload of the block being filled
+    uint32_t blockShotsNum;
+    uint16_t blockMinVelocity, blockMaxVelocity;
+    uint64_t blockFirstIndex;
+    int64_t blockPrevPosition;
+    uint64_t nextIndex;
+    int64_t prevPosition;  // 0 - unknown
+    std::chrono::steady_clock::time_point blockStartTime;
+
+    void WriterMain();
+    void AddShot(const AsgShotEvent& event);
+    void WriteBlock();
+
+public:
+    explicit AsgShotLogWriter(size_t queueCapacity = DEFAULT_QUEUE_CAPACITY);
+    ~AsgShotLogWriter();
+    AsgShotLogWriter(const AsgShotLogWriter&) = delete;
+    AsgShotLogWriter& operator=(const AsgShotLogWriter&) = delete;
+
+    /**
+     * Create the log (overwriting an existing file) and start the writer thread.
+     */
+    bool Open(const char* path, const AsgCounterConfig& config);
+
+    /**
+     * Write the queued shots and close the log. Waits for the writer thread, also after Finish().
+     */
+    void Close();
+
+    /**
+     * Close the log without waiting (detector thread). The writer thread writes the queued shots,
+     * then the shots kept in the history from index "firstIndex" on and closes the file. Only the
+     * first call allocates the copy of the history. Open() and Close() wait until it's done.
+     */
+    void Finish(const AsgShotHistory& history, uint64_t firstIndex = 0);
+
+    bool IsOpen() const;
+
+    /**
+     * Queue a shot (detector thread). Returns false if the queue is full and the shot was dropped.
+     */
+    bool Push(const AsgShotEvent& event);
+
+    /**
+     * Queue a shot of the stats history, e.g. from its spill callback (detector thread):
+     *   stats.history.SetSpillCallback([&writer](uint64_t index, const AsgStatsSample& sample)
+     *       { writer.Push(index, sample); });
+     */
+    bool Push(uint64_t index, const AsgStatsSample& sample);
+
+    /**
+     * Queue the shots still kept in the history, so that the log of its spilled shots has the whole
+     * session. Waits for the writer thread if the queue is full (not for the real-time threads).
+     */
+    void PushHistory(const AsgShotHistory& history);
+
+    /**
+     * Number of shots dropped because the writer thread didn't keep up.
+     */
+    uint64_t GetDroppedNum() const;
+
+    /**
+     * True if writing to the file failed (the following shots are dropped).
+     */
+    bool HasFailed() const;
+};
+
+/**
+ * Reads a shot log. Open() indexes the blocks by reading their headers only, queries then read just
+ * the blocks containing the requested shots.
+ */
+class AsgShotLogReader
+{
+    struct BlockInfo
+    {
+        uint64_t offset;  // of the payload
+        uint64_t firstIndex;
+        int64_t prevPosition;
+        uint32_t shotsNum;
+        uint32_t payloadSize;
+        float minVelocity, maxVelocity;
+    };
+
+    FILE* file;
+    AsgCounterConfig config;
+    int64_t startTime;
+    std::vector<BlockInfo> blocks;
+    std::vector<uint8_t> payload;
+
+    bool ReadBlock(const BlockInfo& block, uint64_t first, uint64_t end, float minVelocity, float maxVelocity,
+                   std::vector<AsgLoggedShot>& shots);
+
+public:
+    AsgShotLogReader();
+    ~AsgShotLogReader();
+    AsgShotLogReader(const AsgShotLogReader&) = delete;
+    AsgShotLogReader& operator=(const AsgShotLogReader&) = delete;
+
+    bool Open(const char* path);
+    void Close();
+
+    /**
+     * Config of the logged session.
+     */
+    const AsgCounterConfig& GetConfig() const;
+
+    /**
+     * Session start (unix time).
+     */
+    int64_t GetStartTime() const;
+
+    /**
+     * Number of the shots up to the last logged one (shots dropped by the writer are missing).
+     */
+    uint64_t GetShotsNum() const;
+
+    /**
+     * Append the logged shots with index in [first, first + count) and velocity in
+     * [minVelocity, maxVelocity] (meters per second, -1 if not measured) to shots.
+     * Returns false if the log can't be read.
+     */
+    bool ReadShots(uint64_t first, uint64_t count, std::vector<AsgLoggedShot>& shots,
+                   float minVelocity = -FLT_MAX, float maxVelocity = FLT_MAX);
+};
@@ -0,0 +1,274 @@
+#include "stdafx.h"
+#include "Simd.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define ASG_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ASG_TARGET_SSE2
+#define ASG_TARGET_AVX
+#else
+#define ASG_TARGET_SSE2 __attribute__((target("sse2")))
+#define ASG_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+namespace {
+
+typedef size_t (*FindFirstAboveFunc)(const float*, size_t, float);
+typedef float (*SumSquaresFunc)(const float*, size_t);
+typedef float (*DotProductFunc)(const float*, const float*, size_t);
+
+struct SimdFunctions
+{
+    FindFirstAboveFunc findFirstAbove;
+    SumSquaresFunc sumSquares;
+    DotProductFunc dotProduct;
+    const char* name;
+};
+
+// Scalar implementation ==========================================================================
+
+size_t FindFirstAboveScalar(const float* samples, size_t samplesNum, float treshold)
+{
+    for (size_t i = 0; i < samplesNum; ++i)
+    {
+        float sample = samples[i];
+        if ((sample > treshold) || (-sample > treshold))
+            return i;
+    }
+    return samplesNum;
+}
+
+float SumSquaresScalar(const float* samples, size_t samplesNum)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < samplesNum; ++i)
+        sum += samples[i] * samples[i];
+    return sum;
+}
+
+float DotProductScalar(const float* a, const float* b, size_t samplesNum)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < samplesNum; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+#ifdef ASG_SIMD_X86
+
+// SSE2 implementation ============================================================================
+
+ASG_TARGET_SSE2
+size_t FindFirstAboveSSE2(const float* samples, size_t samplesNum, float treshold)
+{
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 tresholdVec = _mm_set1_ps(treshold);
+
+    size_t i = 0;
+    for (; i + 16 <= samplesNum; i += 16)
+    {
+        __m128 a = _mm_and_ps(_mm_loadu_ps(samples + i), absMask);
+        __m128 b = _mm_and_ps(_mm_loadu_ps(samples + i + 4), absMask);
+        __m128 c = _mm_and_ps(_mm_loadu_ps(samples + i + 8), absMask);
+        __m128 d = _mm_and_ps(_mm_loadu_ps(samples + i + 12), absMask);
+
+        __m128 above = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(a, tresholdVec), _mm_cmpgt_ps(b, tresholdVec)),
+                                 _mm_or_ps(_mm_cmpgt_ps(c, tresholdVec), _mm_cmpgt_ps(d, tresholdVec)));
+        if (_mm_movemask_ps(above))
+            break;
+    }
+
+    return i + FindFirstAboveScalar(samples + i, samplesNum - i, treshold);
+}
+
+ASG_TARGET_SSE2
+float SumSquaresSSE2(const float* samples, size_t samplesNum)
+{
+    __m128 sumA = _mm_setzero_ps();
+    __m128 sumB = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= samplesNum; i += 8)
+    {
+        __m128 a = _mm_loadu_ps(samples + i);
+        __m128 b = _mm_loadu_ps(samples + i + 4);
+        sumA = _mm_add_ps(sumA, _mm_mul_ps(a, a));
+        sumB = _mm_add_ps(sumB, _mm_mul_ps(b, b));
+    }
+
+    float partial[4];
+    _mm_storeu_ps(partial, _mm_add_ps(sumA, sumB));
+    return partial[0] + partial[1] + partial[2] + partial[3] +
+        SumSquaresScalar(samples + i, samplesNum - i);
+}
+
+ASG_TARGET_SSE2
+float DotProductSSE2(const float* a, const float* b, size_t samplesNum)
+{
+    __m128 sum = _mm_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 4 <= samplesNum; i += 4)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+
+    float partial[4];
+    _mm_storeu_ps(partial, sum);
+    return partial[0] + partial[1] + partial[2] + partial[3] + DotProductScalar(a + i, b + i, samplesNum - i);
+}
+
+// AVX implementation =============================================================================
+
+ASG_TARGET_AVX
+size_t FindFirstAboveAVX(const float* samples, size_t samplesNum, float treshold)
+{
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256 tresholdVec = _mm256_set1_ps(treshold);
+
+    size_t i = 0;
+    for (; i + 32 <= samplesNum; i += 32)
+    {
+        __m256 a = _mm256_and_ps(_mm256_loadu_ps(samples + i), absMask);
+        __m256 b = _mm256_and_ps(_mm256_loadu_ps(samples + i + 8), absMask);
+        __m256 c = _mm256_and_ps(_mm256_loadu_ps(samples + i + 16), absMask);
+        __m256 d = _mm256_and_ps(_mm256_loadu_ps(samples + i + 24), absMask);
+
+        __m256 above = _mm256_or_ps(
+            _mm256_or_ps(_mm256_cmp_ps(a, tresholdVec, _CMP_GT_OQ), _mm256_cmp_ps(b, tresholdVec, _CMP_GT_OQ)),
+            _mm256_or_ps(_mm256_cmp_ps(c, tresholdVec, _CMP_GT_OQ), _mm256_cmp_ps(d, tresholdVec, _CMP_GT_OQ)));
+        if (_mm256_movemask_ps(above))
+            break;
+    }
+
+    return i + FindFirstAboveScalar(samples + i, samplesNum - i, treshold);
+}
+
+ASG_TARGET_AVX
+float SumSquaresAVX(const float* samples, size_t samplesNum)
+{
+    __m256 sumA = _mm256_setzero_ps();
+    __m256 sumB = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 16 <= samplesNum; i += 16)
+    {
+        __m256 a = _mm256_loadu_ps(samples + i);
+        __m256 b = _mm256_loadu_ps(samples + i + 8);
+        sumA = _mm256_add_ps(sumA, _mm256_mul_ps(a, a));
+        sumB = _mm256_add_ps(sumB, _mm256_mul_ps(b, b));
+    }
+
+    float partial[8];
+    _mm256_storeu_ps(partial, _mm256_add_ps(sumA, sumB));
+    float sum = 0.0f;
+    for (int j = 0; j < 8; ++j)
+        sum += partial[j];
+    return sum + SumSquaresScalar(samples + i, samplesNum - i);
+}
+
+ASG_TARGET_AVX
+float DotProductAVX(const float* a, const float* b, size_t samplesNum)
+{
+    __m256 sum = _mm256_setzero_ps();
+
+    size_t i = 0;
+    for (; i + 8 <= samplesNum; i += 8)
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+    float partial[8];
+    _mm256_storeu_ps(partial, sum);
+    float total = 0.0f;
+    for (int j = 0; j < 8; ++j)
+        total += partial[j];
+    return total + DotProductScalar(a + i, b + i, samplesNum - i);
+}
+
+bool CpuSupportsSSE2()
+{
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+bool CpuSupportsAVX()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const int osxsave = 1 << 27;
+    const int avx = 1 << 28;
+    if ((info[2] & (osxsave | avx)) != (osxsave | avx))
+        return false;
+
+    // the OS must preserve YMM registers state
+    return (_xgetbv(0) & 6) == 6;
+#else
+    return __builtin_cpu_supports("avx") != 0;
+#endif
+}
+
+#endif // ASG_SIMD_X86
+
+SimdFunctions SelectSimdFunctions()
+{
+    SimdFunctions functions;
+    functions.findFirstAbove = FindFirstAboveScalar;
+    functions.sumSquares = SumSquaresScalar;
+    functions.dotProduct = DotProductScalar;
+    functions.name = "scalar";
+
+#ifdef ASG_SIMD_X86
+    if (CpuSupportsAVX())
+    {
+        functions.findFirstAbove = FindFirstAboveAVX;
+        functions.sumSquares = SumSquaresAVX;
+        functions.dotProduct = DotProductAVX;
+        functions.name = "AVX";
+    }
+    else if (CpuSupportsSSE2())
+    {
+        functions.findFirstAbove = FindFirstAboveSSE2;
+        functions.sumSquares = SumSquaresSSE2;
+        functions.dotProduct = DotProductSSE2;
+        functions.name = "SSE2";
+    }
+#endif
+
+    return functions;
+}
+
+const SimdFunctions& GetSimdFunctions()
+{
+    static const SimdFunctions functions = SelectSimdFunctions();
+    return functions;
+}
+
+} // namespace
+
+size_t AsgFindFirstAbove(const float* samples, size_t samplesNum, float treshold)
+{
+    return GetSimdFunctions().findFirstAbove(samples, samplesNum, treshold);
+}
+
+float AsgSumSquares(const float* samples, size_t samplesNum)
+{
+    return GetSimdFunctions().sumSquares(samples, samplesNum);
+}
+
+float AsgDotProduct(const float* a, const float* b, size_t samplesNum)
+{
+    return GetSimdFunctions().dotProduct(a, b, samplesNum);
+}
+
+const char* AsgSimdLevelName()
+{
+    return GetSimdFunctions().name;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Vectorized helpers for the hot loops of AsgCounter.
+ * The best implementation (AVX, SSE2 or scalar) is picked at runtime on the first call.
+ */
+
+/**
+ * Find the first sample which magnitude is above the treshold.
+ * Returns samplesNum if there is no such sample.
+ */
+size_t AsgFindFirstAbove(const float* samples, size_t samplesNum, float treshold);
+
+/**
+ * Calculate sum of squared samples (for RMS calculation).
+ */
+float AsgSumSquares(const float* samples, size_t samplesNum);
+
+/**
+ * Calculate dot product of two vectors (for cross-correlation).
+ */
+float AsgDotProduct(const float* a, const float* b, size_t samplesNum);
+
+/**
+ * Get name of the instruction set selected at runtime ("AVX", "SSE2" or "scalar").
+ */
+const char* AsgSimdLevelName();
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+
+/**
+ * Wait-free "triple buffer" for publishing a value from one writer thread to one reader thread.
+ * The reader always gets the latest complete value, neither side ever blocks.
+ */
+template<typename T>
+class AsgSnapshot
+{
+    static const int DIRTY_FLAG = 4;
+    static const int INDEX_MASK = 3;
+
+    T buffers[3];
+    std::atomic<int> backIndex;  // buffer exchanged between the threads (with DIRTY_FLAG if fresh)
+    int writeIndex;
+    int readIndex;
+
+public:
+    AsgSnapshot()
+        : backIndex(1)
+        , writeIndex(0)
+        , readIndex(2)
+    {
+    }
+
+    /**
+     * Get buffer to be filled by the writer thread.
+     */
+    T& GetWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    /**
+     * Make the write buffer contents visible to the reader (writer thread only).
+     */
+    void Publish()
+    {
+        writeIndex = backIndex.exchange(writeIndex | DIRTY_FLAG, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    /**
+     * Fetch the latest published value (reader thread only).
+     * Returns true if a new value has been published since the last call.
+     */
+    bool Update()
+    {
+        if ((backIndex.load(std::memory_order_relaxed) & DIRTY_FLAG) == 0)
+            return false;
+
+        readIndex = backIndex.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    /**
+     * Get the value fetched by the last Update() call (reader thread only).
+     */
+    const T& Get() const
+    {
+        return buffers[readIndex];
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+/**
+ * Lock-free, wait-free ring buffer for exactly one producer thread and one consumer thread.
+ * Capacity is rounded up to a power of two.
+ */
+template<typename T>
+class AsgSpscRing
+{
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    std::vector<T> items;
+    size_t mask;
+
+    // producer and consumer positions are kept in separate cache lines
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> writePos;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> readPos;
+
+public:
+    explicit AsgSpscRing(size_t capacity = 1)
+    {
+        Resize(capacity);
+    }
+
+    /**
+     * Change capacity and drop all the items. Not thread-safe.
+     */
+    void Resize(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        items.resize(size);
+        mask = size - 1;
+        writePos.store(0, std::memory_order_relaxed);
+        readPos.store(0, std::memory_order_relaxed);
+    }
+
+    size_t GetCapacity() const
+    {
+        return items.size();
+    }
+
+    /**
+     * Number of items ready to be popped.
+     */
+    size_t GetSize() const
+    {
+        return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Push items (producer thread only).
+     * Returns number of items pushed - less than itemsNum if the ring is full.
+     */
+    size_t Push(const T* data, size_t itemsNum)
+    {
+        const size_t write = writePos.load(std::memory_order_relaxed);
+        const size_t read = readPos.load(std::memory_order_acquire);
+        const size_t toPush = std::min(itemsNum, items.size() - (write - read));
+
+        for (size_t i = 0; i < toPush; ++i)
+            items[(write + i) & mask] = data[i];
+
+        writePos.store(write + toPush, std::memory_order_release);
+        return toPush;
+    }
+
+    bool Push(const T& item)
+    {
+        return Push(&item, 1) == 1;
+    }
+
+    /**
+     * Pop items (consumer thread only).
+     * Returns number of items popped.
+     */
+    size_t Pop(T* data, size_t maxItems)
+    {
+        const size_t read = readPos.load(std::memory_order_relaxed);
+        const size_t write = writePos.load(std::memory_order_acquire);
+        const size_t toPop = std::min(maxItems, write - read);
+
+        for (size_t i = 0; i < toPop; ++i)
+            data[i] = items[(read + i) & mask];
+
+        readPos.store(read + toPop, std::memory_order_release);
+        return toPop;
+    }
+
+    bool Pop(T& item)
+    {
+        return Pop(&item, 1) == 1;
+    }
+};
@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+
+const size_t AsgTrace::TRACE_RING_SIZE;
+
+namespace {
+
+enum class EventType : uint32_t
+{
+    Span,
+    Counter
+};
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t time;  // start of the span
+    union
+    {
+        uint64_t duration;  // span
+        double value;       // counter
+    };
+    EventType type;
+};
+
+struct ThreadBuffer
+{
+    std::vector<TraceEvent> events;  // ring of the last TRACE_RING_SIZE events
+    std::atomic<uint64_t> writtenNum;
+    size_t threadId;
+    std::string name;  // guarded by registryLock
+    bool active;       // owned by a running thread, guarded by registryLock
+};
+
+// Buffers are kept after their threads end, so that their events can be exported. A new thread
+// takes over the buffer of an ended one (e.g. a decoder thread restarted on every seek), so the
+// memory is bounded by the number of threads running at once.
+std::mutex registryLock;
+std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+std::vector<ThreadBuffer*> freeBuffers;
+
+// returns the buffer of the thread when the thread ends
+struct ThreadBufferOwner
+{
+    ThreadBuffer* buffer;
+
+    ThreadBufferOwner()
+        : buffer(nullptr)
+    {
+    }
+
+    ~ThreadBufferOwner()
+    {
+        if (buffer == nullptr)
+            return;
+
+        std::lock_guard<std::mutex> guard(registryLock);
+        buffer->active = false;
+        freeBuffers.push_back(buffer);
+    }
+};
+
+thread_local ThreadBufferOwner threadBufferOwner;
+
+ThreadBuffer* GetThreadBuffer()
+{
+    if (threadBufferOwner.buffer == nullptr)
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+
+        // the events of the previous thread stay in the ring until they are overwritten
+        ThreadBuffer* buffer;
+        if (!freeBuffers.empty())
+        {
+            buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+        else
+        {
+            threadBuffers.emplace_back(new ThreadBuffer);
+            buffer = threadBuffers.back().get();
+            buffer->events.resize(AsgTrace::TRACE_RING_SIZE);
+            buffer->writtenNum = 0;
+            buffer->threadId = threadBuffers.size();
+        }
+
+        buffer->name = "Thread " + std::to_string(buffer->threadId);
+        buffer->active = true;
+        threadBufferOwner.buffer = buffer;
+    }
+    return threadBufferOwner.buffer;
+}
+
+void Record(const TraceEvent& event)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    const uint64_t pos = buffer->writtenNum.load(std::memory_order_relaxed);
+    buffer->events[static_cast<size_t>(pos % AsgTrace::TRACE_RING_SIZE)] = event;
+    buffer->writtenNum.store(pos + 1, std::memory_order_release);
+}
+
+// first event still in the ring
+uint64_t GetOldestEvent(uint64_t writtenNum)
+{
+    return writtenNum > AsgTrace::TRACE_RING_SIZE ? writtenNum - AsgTrace::TRACE_RING_SIZE : 0;
+}
+
+// string literal with the JSON special characters escaped
+void WriteJsonString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* c = text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if (static_cast<unsigned char>(*c) < 0x20)
+            fprintf(file, "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(*c)));
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+} // namespace
+
+bool AsgTrace::IsCompiledIn()
+{
+#ifdef ASG_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AsgTrace::AddSpan(const char* name, uint64_t startTime, uint64_t endTime)
+{
+    TraceEvent event;
+    event.name = name;
+    event.time = startTime;
+    event.duration = endTime - startTime;
+    event.type = EventType::Span;
+    Record(event);
+}
+
+void AsgTrace::AddCounter(const char* name, double value)
+{
+    TraceEvent event;
+    event.name = name;
+    event.time = GetTime();
+    event.value = value;
+    event.type = EventType::Counter;
+    Record(event);
+}
+
+void AsgTrace::SetThreadName(const char* name)
+{
+    ThreadBuffer* buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> guard(registryLock);
+    buffer->name = name;
+}
+
+bool AsgTrace::Export(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> guard(registryLock);
+
+    // Copy the rings first, the events overwritten during the copy are dropped. A running thread
+    // may be writing the event after the last counted one, so its slot is not trusted either. The
+    // rings of the ended threads don't change while the lock is held.
+    std::vector<std::vector<TraceEvent>> events(threadBuffers.size());
+    uint64_t startTime = UINT64_MAX;
+    for (size_t i = 0; i < threadBuffers.size(); ++i)
+    {
+        const ThreadBuffer& buffer = *threadBuffers[i];
+        const uint64_t endNum = buffer.writtenNum.load(std::memory_order_acquire);
+        for (uint64_t j = GetOldestEvent(endNum); j < endNum; ++j)
+            events[i].push_back(buffer.events[static_cast<size_t>(j % TRACE_RING_SIZE)]);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t writingNum = buffer.writtenNum.load(std::memory_order_relaxed) + (buffer.active ? 1 : 0);
+        const uint64_t overwrittenNum = GetOldestEvent(writingNum) - GetOldestEvent(endNum);
+        events[i].erase(events[i].begin(), events[i].begin() + static_cast<size_t>(
+            std::min<uint64_t>(overwrittenNum, events[i].size())));
+
+        for (const TraceEvent& event : events[i])
+            startTime = std::min(startTime, event.time);
+    }
+
+    // timestamps in microseconds since the first event
+    fprintf(file, "{\n  \"displayTimeUnit\": \"ns\",\n  \"traceEvents\": [");
+    const char* separator = "\n";
+    for (size_t i = 0; i < threadBuffers.size(); ++i)
+    {
+        const size_t threadId = threadBuffers[i]->threadId;
+        fprintf(file, "%s    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, "
+                "\"args\": { \"name\": ", separator, (unsigned)threadId);
+        WriteJsonString(file, threadBuffers[i]->name.c_str());
+        fprintf(file, " } }");
+        separator = ",\n";
+
+        for (const TraceEvent& event : events[i])
+        {
+            const double ts = static_cast<double>(event.time - startTime) / 1000.0;
+            fprintf(file, ",\n    { \"name\": ");
+            WriteJsonString(file, event.name);
+            if (event.type == EventType::Span)
+            {
+                fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f }",
+                        (unsigned)threadId, ts, static_cast<double>(event.duration) / 1000.0);
+            }
+            else
+            {
+                fprintf(file, ", \"ph\": \"C\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"args\": { \"value\": %.17g } }",
+                        (unsigned)threadId, ts, event.value);
+            }
+        }
+    }
+    fprintf(file, "\n  ]\n}\n");
+
+    return fclose(file) == 0;
+}
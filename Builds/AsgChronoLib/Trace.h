@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Tracing of the hot paths, exported in the Chrome trace format (chrome://tracing, Perfetto UI).
+ *
+ * Compiled in only with ASG_TRACE defined, otherwise the macros expand to nothing. Every thread
+ * records into its own ring of the last TRACE_RING_SIZE events, so recording never blocks or
+ * allocates (except for the first event of a thread). The ring of an ended thread is exported until
+ * a new thread takes it over. Export can run any time, events overwritten while they are being
+ * exported are skipped.
+ *
+ *   ASG_TRACE_SCOPE("Analyze");            span from here to the end of the scope
+ *   ASG_TRACE_COUNTER("Queued", value);    counter value at this moment
+ *   ASG_TRACE_THREAD_NAME("Detector");     name of the calling thread (set once per thread)
+ *
+ * Names must be string literals (only the pointers are stored).
+ */
+
+#ifdef ASG_TRACE
+#define ASG_TRACE_CONCAT_(a, b) a##b
+#define ASG_TRACE_CONCAT(a, b) ASG_TRACE_CONCAT_(a, b)
+#define ASG_TRACE_SCOPE(name) AsgTraceScope ASG_TRACE_CONCAT(asgTraceScope, __LINE__)(name)
+#define ASG_TRACE_COUNTER(name, value) AsgTrace::AddCounter(name, static_cast<double>(value))
+#define ASG_TRACE_THREAD_NAME(name) \
+    static thread_local bool ASG_TRACE_CONCAT(asgTraceNamed, __LINE__) = (AsgTrace::SetThreadName(name), true); \
+    (void)ASG_TRACE_CONCAT(asgTraceNamed, __LINE__)
+#else
+#define ASG_TRACE_SCOPE(name)
+#define ASG_TRACE_COUNTER(name, value)
+#define ASG_TRACE_THREAD_NAME(name)
+#endif
+
+class AsgTrace
+{
+public:
+    static const size_t TRACE_RING_SIZE = 32 * 1024;  // events per thread
+
+    /**
+     * True if built with ASG_TRACE.
+     */
+    static bool IsCompiledIn();
+
+    /**
+     * Monotonic time in nanoseconds (the time base of the events).
+     */
+    static uint64_t GetTime()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    static void AddSpan(const char* name, uint64_t startTime, uint64_t endTime);
+    static void AddCounter(const char* name, double value);
+
+    /**
+     * Name of the calling thread shown in the trace.
+     */
+    static void SetThreadName(const char* name);
+
+    /**
+     * Write the recorded events of all the threads as Chrome trace JSON.
+     */
+    static bool Export(const char* path);
+};
+
+/**
+ * Records span of its lifetime.
+ */
+class AsgTraceScope
+{
+    const char* name;
+    uint64_t startTime;
+
+public:
+    explicit AsgTraceScope(const char* name)
+        : name(name)
+        , startTime(AsgTrace::GetTime())
+    {
+    }
+
+    ~AsgTraceScope()
+    {
+        AsgTrace::AddSpan(name, startTime, AsgTrace::GetTime());
+    }
+
+    AsgTraceScope(const AsgTraceScope&) = delete;
+    AsgTraceScope& operator=(const AsgTraceScope&) = delete;
+};
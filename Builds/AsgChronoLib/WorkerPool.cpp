@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include "WorkerPool.h"
+#include "Trace.h"
+
+AsgWorkerPool::AsgWorkerPool(size_t threadsNum)
+    : task(nullptr)
+    , tasksNum(0)
+    , nextTask(0)
+    , pendingWorkers(0)
+    , jobId(0)
+    , quit(false)
+{
+    if (threadsNum == 0)
+        threadsNum = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    for (size_t i = 1; i < threadsNum; ++i)
+        threads.push_back(std::thread(&AsgWorkerPool::WorkerMain, this));
+}
+
+AsgWorkerPool::~AsgWorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        quit = true;
+    }
+    wakeUpCondition.notify_all();
+
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+}
+
+size_t AsgWorkerPool::GetThreadsNum() const
+{
+    return threads.size() + 1;
+}
+
+void AsgWorkerPool::RunTasks(const AsgTask& task, size_t tasksNum)
+{
+    for (;;)
+    {
+        size_t i = nextTask.fetch_add(1);
+        if (i >= tasksNum)
+            break;
+
+        task(i);
+    }
+}
+
+void AsgWorkerPool::WorkerMain()
+{
+    ASG_TRACE_THREAD_NAME("Worker");
+    unsigned int lastJobId = 0;
+
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;)
+    {
+        wakeUpCondition.wait(guard, [&] { return quit || jobId != lastJobId; });
+        if (quit)
+            return;
+
+        // the job can't change until every worker finished it, so the copies stay valid
+        lastJobId = jobId;
+        const AsgTask* jobTask = task;
+        const size_t jobTasksNum = tasksNum;
+
+        guard.unlock();
+        RunTasks(*jobTask, jobTasksNum);
+        guard.lock();
+
+        if (--pendingWorkers == 0)
+            doneCondition.notify_all();
+    }
+}
+
+void AsgWorkerPool::ParallelFor(size_t tasksNum, const AsgTask& task)
+{
+    if (threads.empty() || tasksNum <= 1)
+    {
+        for (size_t i = 0; i < tasksNum; ++i)
+            task(i);
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        this->task = &task;
+        this->tasksNum = tasksNum;
+        nextTask = 0;
+        pendingWorkers = threads.size();
+        jobId++;
+    }
+    wakeUpCondition.notify_all();
+
+    RunTasks(task, tasksNum);
+
+    // wait for every worker, also the ones which woke up too late to get any task, so that none
+    // of them can pick up the next job's index with this job's task
+    std::unique_lock<std::mutex> guard(lock);
+    doneCondition.wait(guard, [&] { return pendingWorkers == 0; });
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+
+typedef std::function<void(size_t)> AsgTask;
+
+/**
+ * Simple pool of worker threads for data-parallel jobs.
+ */
+class AsgWorkerPool
+{
+    std::vector<std::thread> threads;
+
+    std::mutex lock;
+    std::condition_variable wakeUpCondition;
+    std::condition_variable doneCondition;
+
+    // current job, guarded by the lock (only nextTask is shared without it)
+    const AsgTask* task;
+    size_t tasksNum;
+    std::atomic<size_t> nextTask;
+    size_t pendingWorkers;  // workers which haven't finished the current job yet
+    unsigned int jobId;
+    bool quit;
+
+    void WorkerMain();
+    void RunTasks(const AsgTask& task, size_t tasksNum);
+
+public:
+    /**
+     * Create pool using "threadsNum" threads in total (including the calling one).
+     * 0 means number of hardware threads.
+     */
+    explicit AsgWorkerPool(size_t threadsNum = 0);
+    ~AsgWorkerPool();
+
+    size_t GetThreadsNum() const;
+
+    /**
+     * Call task(i) for every i in [0, tasksNum) and wait for all of them.
+     * The calling thread takes part in the job too.
+     */
+    void ParallelFor(size_t tasksNum, const AsgTask& task);
+};
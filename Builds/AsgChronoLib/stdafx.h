@@ -1,4 +1,10 @@
 #pragma once
 
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
 #include <vector>
+#include <algorithm>
 #include <string>
\ No newline at end of file
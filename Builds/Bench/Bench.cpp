@@ -0,0 +1,607 @@
+// Benchmarks of the detection pipeline. Results are written as JSON (stdout or --json <path>).
+//
+// Building without Visual Studio (e.g. on Linux):
+//   g++ -std=c++11 -O2 -pthread -I../AsgChronoLib ../AsgChronoLib/*.cpp *.cpp -o asgchrono-bench
+
+#include "stdafx.h"
+#include "../AsgChronoLib/Counter.h"
+#include "../AsgChronoLib/CaptureReader.h"
+#include "../AsgChronoLib/ParallelAnalyzer.h"
+#include "../AsgChronoLib/ShotLog.h"
+#include "../AsgChronoLib/Trace.h"
+#include "../AsgChronoLib/LatencyHistogram.h"
+
+// Allocations counting ===========================================================================
+
+static std::atomic<size_t> allocationsNum(0);
+
+void* operator new(size_t size)
+{
+    allocationsNum++;
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+namespace {
+
+const size_t READ_SPAN = 16 * 1024;  // same as Test.cpp
+const double MIN_BENCH_TIME = 0.2;   // in seconds, per measurement
+const int MEASUREMENTS_NUM = 5;      // the best one is reported
+
+struct BenchResult
+{
+    std::string name;
+    double nsPerSample;     // or per call, for non-stream benchmarks
+    double nsPerShot;       // extra cost of a detected shot (peaks search and refinement), -1 if unknown
+    double allocsPerRun;    // allocations per processed stream (or per call)
+    size_t samplesNum;
+    size_t shotsNum;
+};
+
+std::vector<BenchResult> results;
+
+/**
+ * Call "run" repeatedly and return the best time of a single call in nanoseconds.
+ * "allocs" receives the number of allocations per call.
+ */
+template <typename Func>
+double Measure(Func run, double& allocs)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // warm up caches and let the lazy initialization (e.g. SIMD dispatch) happen
+    run();
+
+    double best = 1.0e30;
+    size_t totalAllocs = 0;
+    size_t totalRuns = 0;
+    for (int m = 0; m < MEASUREMENTS_NUM; ++m)
+    {
+        size_t runs = 0;
+        size_t allocsBefore = allocationsNum;
+        Clock::time_point start = Clock::now();
+        double elapsed;
+        do
+        {
+            run();
+            runs++;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < MIN_BENCH_TIME / MEASUREMENTS_NUM);
+
+        totalAllocs += allocationsNum - allocsBefore;
+        totalRuns += runs;
+        best = std::min(best, 1.0e9 * elapsed / static_cast<double>(runs));
+    }
+
+    allocs = static_cast<double>(totalAllocs) / static_cast<double>(totalRuns);
+    return best;
+}
+
+/**
+ * Run the counter over the whole stream, fed in "span" long buffers.
+ */
+size_t ProcessStream(AsgCounter& counter, const std::vector<float>& samples, size_t span)
+{
+    counter.Reset();
+    for (size_t pos = 0; pos < samples.size(); pos += span)
+        counter.ProcessBuffer(samples.data() + pos, std::min(span, samples.size() - pos));
+    return counter.GetStats().shotsNum;
+}
+
+BenchResult BenchStream(const std::string& name, const std::vector<float>& samples, size_t span,
+                        const AsgCounterConfig& config = AsgCounterConfig())
+{
+    AsgCounter counter;
+    counter.GetConfig() = config;
+    counter.Reset();
+
+    BenchResult result;
+    result.name = name;
+    result.samplesNum = samples.size();
+    result.shotsNum = ProcessStream(counter, samples, span);
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&] { ProcessStream(counter, samples, span); }, result.allocsPerRun);
+    result.nsPerSample = ns / static_cast<double>(std::max<size_t>(samples.size(), 1));
+    return result;
+}
+
+// Synthetic streams ==============================================================================
+
+struct SyntheticParams
+{
+    float seconds;
+    float shotsPerSecond;
+    float noiseLevel;   // RMS of the gaussian noise
+    float amplitude;    // pulse amplitude
+    float velocity;     // in m/s, defines distance of the twin pulses
+};
+
+std::vector<float> GenerateStream(const SyntheticParams& params, const AsgCounterConfig& config)
+{
+    std::mt19937 random(12345);
+    std::normal_distribution<float> noise(0.0f, params.noiseLevel);
+
+    std::vector<float> samples(static_cast<size_t>(params.seconds * config.sampleRate));
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = noise(random);
+
+    if (params.shotsPerSecond <= 0.0f)
+        return samples;
+
+    // twin gaussian pulses (photocell shadows of the BB)
+    const float pulseWidth = 2.0f;
+    const int pulseRadius = 8;
+    const float distance = config.length * config.sampleRate / params.velocity;
+    const float interval = config.sampleRate / params.shotsPerSecond;
+
+    for (float shot = interval * 0.5f; shot + distance + pulseRadius < samples.size(); shot += interval)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            float center = shot + k * distance;
+            int first = static_cast<int>(center) - pulseRadius;
+            for (int i = first; i <= first + 2 * pulseRadius; ++i)
+            {
+                float x = (static_cast<float>(i) - center) / pulseWidth;
+                samples[i] -= params.amplitude * expf(-0.5f * x * x);
+            }
+        }
+    }
+
+    return samples;
+}
+
+void BenchSynthetic()
+{
+    AsgCounterConfig config;
+    const float noiseLevels[] = {0.001f, 0.01f};
+    const float shotRates[] = {0.0f, 1.0f, 10.0f, 20.0f};
+
+    for (float noiseLevel : noiseLevels)
+    {
+        double silenceNs = 0.0;
+        for (float shotRate : shotRates)
+        {
+            SyntheticParams params;
+            params.seconds = 60.0f;
+            params.shotsPerSecond = shotRate;
+            params.noiseLevel = noiseLevel;
+            params.amplitude = 0.5f;
+            params.velocity = 100.0f;
+
+            std::vector<float> samples = GenerateStream(params, config);
+
+            char name[128];
+            snprintf(name, sizeof(name), "synthetic/noise=%g/rate=%g", noiseLevel, shotRate);
+            BenchResult result = BenchStream(name, samples, READ_SPAN, config);
+
+            // the difference to the shot-less stream is the cost of the peaks processing
+            double totalNs = result.nsPerSample * static_cast<double>(samples.size());
+            if (shotRate == 0.0f)
+                silenceNs = totalNs;
+            else if (result.shotsNum > 0)
+                result.nsPerShot = (totalNs - silenceNs) / static_cast<double>(result.shotsNum);
+
+            results.push_back(result);
+        }
+
+        // cross-correlation peaks estimator at the highest shot rate
+        SyntheticParams params;
+        params.seconds = 60.0f;
+        params.shotsPerSecond = shotRates[3];
+        params.noiseLevel = noiseLevel;
+        params.amplitude = 0.5f;
+        params.velocity = 100.0f;
+
+        AsgCounterConfig xcorrConfig = config;
+        xcorrConfig.peakEstimator = AsgPeakEstimator::CrossCorrelation;
+
+        std::vector<float> samples = GenerateStream(params, config);
+        char name[128];
+        snprintf(name, sizeof(name), "synthetic/noise=%g/rate=%g/xcorr", noiseLevel, params.shotsPerSecond);
+        BenchResult result = BenchStream(name, samples, READ_SPAN, xcorrConfig);
+        if (result.shotsNum > 0)
+        {
+            double totalNs = result.nsPerSample * static_cast<double>(samples.size());
+            result.nsPerShot = (totalNs - silenceNs) / static_cast<double>(result.shotsNum);
+        }
+        results.push_back(result);
+    }
+}
+
+void BenchHighSampleRate()
+{
+    // low latency mode at 192 kHz, full rate and decimated noise floor and cross-correlation
+    AsgCounterConfig config;
+    config.sampleRate = 192000.0f;
+    config.minPeakDistance = 130;
+    config.maxPeakDistance = 1300;
+    config.blockSize = 1024;
+    config.rmsWindow = 96000;
+    config.noiseEstimator = AsgNoiseEstimator::Median;
+    config.detectionSigma = 12.0f;
+    config.peakEstimator = AsgPeakEstimator::CrossCorrelation;
+
+    SyntheticParams params;
+    params.seconds = 20.0f;
+    params.shotsPerSecond = 20.0f;
+    params.noiseLevel = 0.01f;
+    params.amplitude = 0.5f;
+    params.velocity = 100.0f;
+    std::vector<float> samples = GenerateStream(params, config);
+
+    const size_t decimations[] = {1, 0};
+    for (size_t decimation : decimations)
+    {
+        config.decimation = decimation;
+
+        char name[128];
+        snprintf(name, sizeof(name), "synthetic/sample_rate=192000/decimation=%s", decimation == 0 ? "auto" : "1");
+        results.push_back(BenchStream(name, samples, READ_SPAN, config));
+    }
+}
+
+// Benchmarks of the individual stages ============================================================
+
+void BenchBlockSizes(const std::vector<float>& samples)
+{
+    // spans equal to the block size are analyzed in place - this is Analyze() alone
+    const size_t blockSizes[] = {256, 1024, 8192};
+    for (size_t blockSize : blockSizes)
+    {
+        AsgCounterConfig config;
+        config.blockSize = blockSize;
+
+        char name[128];
+        snprintf(name, sizeof(name), "analyze/block=%i", (int)blockSize);
+        results.push_back(BenchStream(name, samples, blockSize, config));
+
+        // unaligned spans need copying of the block remainders
+        snprintf(name, sizeof(name), "process_buffer/block=%i/span=1000", (int)blockSize);
+        results.push_back(BenchStream(name, samples, 1000, config));
+    }
+
+    AsgCounterConfig filterConfig;
+    filterConfig.highPassFrequency = 20.0f;
+    filterConfig.humFrequency = 50.0f;
+    results.push_back(BenchStream("analyze/block=8192/pre_filter", samples, 8192, filterConfig));
+
+    AsgCounterConfig config;
+    config.blockSize = 256;
+    config.rmsWindow = 22050;
+    config.detectionSigma = 25.0f;
+    results.push_back(BenchStream("analyze/block=256/sliding_noise_floor", samples, 256, config));
+
+    config.noiseEstimator = AsgNoiseEstimator::Median;
+    results.push_back(BenchStream("analyze/block=256/sliding_noise_floor/median", samples, 256, config));
+}
+
+void BenchAddSample()
+{
+    const size_t samplesNum = 100000;
+    AsgCounterConfig config;
+    AsgStats stats;
+
+    BenchResult result;
+    result.name = "stats/add_sample";
+    result.samplesNum = samplesNum;
+    result.shotsNum = samplesNum;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        stats.Reset();
+        for (size_t i = 0; i < samplesNum; ++i)
+            stats.AddSample(100.0f + (i % 7), 0.1f + 0.001f * (i % 5), static_cast<float>(i * 4410), config);
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(samplesNum);
+    results.push_back(result);
+}
+
+void BenchQuantileSketch()
+{
+    // long session, most of the values go through the compaction of the lower levels
+    const size_t valuesNum = 1000000;
+    AsgQuantileSketch sketch;
+
+    BenchResult result;
+    result.name = "quantile_sketch/add";
+    result.samplesNum = valuesNum;
+    result.shotsNum = valuesNum;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        sketch.Reset();
+        for (size_t i = 0; i < valuesNum; ++i)
+            sketch.Add(100.0f + 0.001f * static_cast<float>((i * 7919) % 10007));
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(valuesNum);
+    results.push_back(result);
+}
+
+void BenchTrace()
+{
+    // cost of ASG_TRACE_SCOPE when compiled in
+    const size_t spansNum = 100000;
+
+    BenchResult result;
+    result.name = "trace/scope";
+    result.samplesNum = spansNum;
+    result.shotsNum = 0;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        for (size_t i = 0; i < spansNum; ++i)
+            AsgTraceScope scope("BenchSpan");
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(spansNum);
+    results.push_back(result);
+}
+
+void BenchLatencyHistogram()
+{
+    // latencies from 1 us to about 1 s, as recorded per shot by the GUI
+    const size_t valuesNum = 1000000;
+    AsgLatencyHistogram histogram;
+
+    BenchResult result;
+    result.name = "latency_histogram/record";
+    result.samplesNum = valuesNum;
+    result.shotsNum = 0;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        histogram.Reset();
+        for (size_t i = 0; i < valuesNum; ++i)
+            histogram.Record(1000 + (i * 7919) % 1000000007);
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(valuesNum);
+    results.push_back(result);
+}
+
+void BenchEventQueue()
+{
+    // one producer and two readers draining in batches, as the GUI and a logger would
+    const size_t eventsNum = 100000;
+    const size_t batchSize = 16;
+    AsgShotEventQueue queue(1024);
+    AsgShotEventQueue::Reader readers[2] = {queue.CreateReader(), queue.CreateReader()};
+    AsgShotEvent event = AsgShotEvent();
+    AsgShotEvent popped[batchSize];
+
+    BenchResult result;
+    result.name = "event_queue/push_pop/readers=2";
+    result.samplesNum = eventsNum;
+    result.shotsNum = eventsNum;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        for (size_t i = 0; i < eventsNum; i += batchSize)
+        {
+            for (size_t j = 0; j < batchSize; ++j)
+            {
+                event.index = i + j;
+                queue.Push(event);
+            }
+            for (AsgShotEventQueue::Reader& reader : readers)
+                queue.Pop(reader, popped, batchSize);
+        }
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(eventsNum);
+    results.push_back(result);
+}
+
+void BenchShotLog()
+{
+    // range query in the middle of a long session, only the overlapping blocks are read
+    const char* path = "asgchrono-bench.asglog";
+    const size_t loggedNum = 200000;
+    const size_t rangeSize = 10000;
+
+    AsgCounterConfig config;
+    AsgShotLogWriter writer(loggedNum);
+    if (!writer.Open(path, config))
+    {
+        fprintf(stderr, "Failed to create %s\n", path);
+        return;
+    }
+
+    AsgShotEvent event = AsgShotEvent();
+    for (size_t i = 0; i < loggedNum; ++i)
+    {
+        event.index = i;
+        event.firstPeak = 1000.0 + 2205.3 * i;
+        event.velocity = 90.0f + (i % 20);
+        writer.Push(event);
+    }
+    writer.Close();
+
+    AsgShotLogReader reader;
+    reader.Open(path);
+    std::vector<AsgLoggedShot> shots;
+    shots.reserve(rangeSize);
+
+    BenchResult result;
+    result.name = "shot_log/read/range=10000";
+    result.samplesNum = rangeSize;
+    result.shotsNum = rangeSize;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        shots.clear();
+        reader.ReadShots(loggedNum / 2, rangeSize, shots);
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(rangeSize);
+    results.push_back(result);
+
+    reader.Close();
+    remove(path);
+}
+
+void BenchCompressedCapture(const std::vector<float>& samples)
+{
+    // decoding of a whole file with the default (all cores) decoder threads
+    const char* path = "asgchrono-bench.asgc";
+    AsgCaptureWriter writer;
+    if (!writer.Open(path, 1, 44100.0f, 16) || !writer.Write(samples.data(), samples.size()) || !writer.Close())
+    {
+        fprintf(stderr, "Failed to create %s\n", path);
+        return;
+    }
+
+    BenchResult result;
+    result.name = "compressed_capture/decode/bits=16";
+    result.samplesNum = samples.size();
+    result.shotsNum = 0;
+    result.nsPerShot = -1.0;
+
+    double ns = Measure([&]
+    {
+        AsgCaptureReader reader;
+        reader.Open(path);
+        const float* span;
+        while (reader.Read(span) > 0)
+            ;
+    }, result.allocsPerRun);
+
+    result.nsPerSample = ns / static_cast<double>(samples.size());
+    results.push_back(result);
+
+    remove(path);
+}
+
+void BenchParallel(const std::vector<float>& samples)
+{
+    AsgParallelAnalyzer analyzer;
+
+    BenchResult result;
+    result.name = "parallel_analyzer";
+    result.samplesNum = samples.size();
+    result.nsPerShot = -1.0;
+
+    analyzer.Analyze(samples.data(), samples.size());
+    result.shotsNum = analyzer.GetStats().shotsNum;
+
+    double ns = Measure([&] { analyzer.Analyze(samples.data(), samples.size()); }, result.allocsPerRun);
+    result.nsPerSample = ns / static_cast<double>(samples.size());
+    results.push_back(result);
+}
+
+// Output =========================================================================================
+
+void WriteJson(FILE* file)
+{
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& result = results[i];
+        fprintf(file, "    { \"name\": \"%s\", \"samples\": %llu, \"shots\": %llu, \"ns_per_sample\": %.4f, "
+                "\"ns_per_shot\": %.1f, \"allocs_per_run\": %.2f }%s\n",
+                result.name.c_str(), (unsigned long long)result.samplesNum, (unsigned long long)result.shotsNum,
+                result.nsPerSample, result.nsPerShot, result.allocsPerRun, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::string testsDir = "../../Tests/";
+    std::string jsonPath;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--tests") == 0)
+            testsDir = std::string(argv[i + 1]) + "/";
+        else if (strcmp(argv[i], "--json") == 0)
+            jsonPath = argv[i + 1];
+    }
+
+    // bundled captures
+    const char* names[] = {"TestSample", "AK", "G36", "G36_rev", "digl"};
+    std::vector<float> longest;
+    for (const char* name : names)
+    {
+        AsgCaptureReader reader;
+        if (!reader.Open((testsDir + name + ".raw").c_str()))
+        {
+            fprintf(stderr, "Failed to open %s%s.raw\n", testsDir.c_str(), name);
+            continue;
+        }
+
+        std::vector<float> samples;
+        const float* span;
+        while (size_t samplesNum = reader.Read(span))
+            samples.insert(samples.end(), span, span + samplesNum);
+
+        results.push_back(BenchStream(std::string("capture/") + name, samples, READ_SPAN));
+        if (samples.size() > longest.size())
+            longest.swap(samples);
+    }
+
+    BenchSynthetic();
+    BenchHighSampleRate();
+    BenchAddSample();
+    BenchQuantileSketch();
+    BenchTrace();
+    BenchLatencyHistogram();
+    BenchEventQueue();
+    BenchShotLog();
+
+    if (!longest.empty())
+    {
+        BenchBlockSizes(longest);
+
+        // long enough to be split into several chunks
+        std::vector<float> repeated;
+        for (int i = 0; i < 16; ++i)
+            repeated.insert(repeated.end(), longest.begin(), longest.end());
+        BenchParallel(repeated);
+        BenchCompressedCapture(repeated);
+    }
+
+    if (jsonPath.empty())
+    {
+        WriteJson(stdout);
+        return 0;
+    }
+
+    FILE* file = fopen(jsonPath.c_str(), "w");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Failed to create %s\n", jsonPath.c_str());
+        return 1;
+    }
+    WriteJson(file);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1 @@
+#include "stdafx.h"
\ No newline at end of file
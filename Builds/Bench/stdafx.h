@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
\ No newline at end of file
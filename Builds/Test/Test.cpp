@@ -1,52 +1,1070 @@
+// Regression tests of the shots detection.
+//
+// Expected results of every capture in Tests/ are stored in <name>.golden next to it. The test fails
+// when a shot is missed or added, a velocity or the fire rate deviates beyond tolerance, or the
+// throughput drops below the recorded minimum. The throughput is relative to a plain scalar pass
+// over the same samples measured in the same run, so that it doesn't depend on the machine speed. Run with "--record" to rewrite the golden files with
+// the current results (comments are kept), and "--tests <dir>" if not started from Builds/Test.
+//
+// Building without Visual Studio (e.g. on Linux):
+//   g++ -std=c++11 -O2 -pthread -I../AsgChronoLib ../AsgChronoLib/*.cpp *.cpp -o asgchrono-test
+
 #include "stdafx.h"
 #include "../AsgChronoLib/Counter.h"
+#include "../AsgChronoLib/CaptureReader.h"
+#include "../AsgChronoLib/ParallelAnalyzer.h"
+#include "../AsgChronoLib/WorkerPool.h"
+#include "../AsgChronoLib/ShotLog.h"
+#include "../AsgChronoLib/Trace.h"
+#include "../AsgChronoLib/LatencyHistogram.h"
+
+const char* CAPTURES[] = {"TestSample", "AK", "G36", "G36_rev", "digl"};
+
+const size_t READ_SPAN = 16 * 1024;
+const float POSITION_TOLERANCE = 2.0f;      // in samples, for matching detected shots with expected ones
+const float VELOCITY_TOLERANCE = 0.005f;    // relative
+const float FIRE_RATE_TOLERANCE = 0.005f;   // relative
+const double RECORDED_THROUGHPUT_RATIO = 0.5;  // minimum relative throughput recorded relative to the measured one
+const double THROUGHPUT_MEASURE_TIME = 0.25;   // in seconds
+const char* SHOT_LOG_PATH = "asgchrono-test.asglog";  // temporary, in the working directory
+const char* COMPRESSED_PATH = "asgchrono-test.asgc";   // temporary, in the working directory
+const char* TRACE_PATH = "asgchrono-test.json";        // temporary, in the working directory
+
+static std::string testsDir = "../../Tests/";
+static int failuresNum = 0;
+
+struct Golden
+{
+    std::vector<std::string> comments;
+    std::vector<AsgStatsSample> shots;
+    float fireRate;
+    double minThroughput;  // relative to the scalar pass, 0 - not checked
+};
 
-#include "Windows.h"
+void Fail(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    printf("FAILED: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+
+    failuresNum++;
+}
 
-const int bufferSize = 16 * 1024;
-static float buffer[bufferSize];
+bool ReadSamples(const std::string& path, std::vector<float>& samples)
+{
+    AsgCaptureReader reader;
+    if (!reader.Open(path.c_str()))
+        return false;
+
+    samples.clear();
+    const float* span;
+    while (size_t samplesNum = reader.Read(span))
+        samples.insert(samples.end(), span, span + samplesNum);
+    return true;
+}
+
+bool ReadCapture(const char* name, std::vector<float>& samples)
+{
+    return ReadSamples(testsDir + name + ".raw", samples);
+}
+
+void Analyze(AsgCounter& counter, const std::vector<float>& samples)
+{
+    counter.Reset();
+    for (size_t pos = 0; pos < samples.size(); pos += READ_SPAN)
+        counter.ProcessBuffer(samples.data() + pos, std::min(READ_SPAN, samples.size() - pos));
+}
 
-void Test(const char* name)
+// in Msamples/s, best of the runs
+double MeasureThroughput(size_t samplesNum, const std::function<void()>& run)
 {
-    std::string path = std::string("..\\..\\Tests\\") + name + ".raw";
-    FILE* file = fopen(path.c_str(), "rb");
-    assert(file != nullptr);
+    using Clock = std::chrono::steady_clock;
+
+    double bestTime = 1.0e30;
+    Clock::time_point start = Clock::now();
+    do
+    {
+        Clock::time_point runStart = Clock::now();
+        run();
+        bestTime = std::min(bestTime, std::chrono::duration<double>(Clock::now() - runStart).count());
+    } while (std::chrono::duration<double>(Clock::now() - start).count() < THROUGHPUT_MEASURE_TIME);
+
+    return static_cast<double>(samplesNum) / std::max(bestTime, 1.0e-9) / 1.0e6;
+}
+
+// speed of the counter relative to a plain scalar loop reading the same samples
+double MeasureRelativeThroughput(const std::vector<float>& samples, size_t shotsNum, double& throughput)
+{
+    AsgCounter counter;
+    throughput = MeasureThroughput(samples.size(), [&] { Analyze(counter, samples); });
+
+    // the timed runs have to do the same work as the checked one
+    if (counter.GetStats().history.GetSize() != shotsNum)
+        Fail("timed analysis found %i shots, expected %i", (int)counter.GetStats().history.GetSize(), (int)shotsNum);
+
+    volatile float sink = 0.0f;
+    double baseline = MeasureThroughput(samples.size(), [&]
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < samples.size(); ++i)
+            sum += samples[i] * samples[i];
+        sink = sum;
+    });
+    (void)sink;
+
+    return throughput / baseline;
+}
+
+// Golden files ===================================================================================
+
+bool LoadGolden(const std::string& path, Golden& golden)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr)
+        return false;
+
+    golden.comments.clear();
+    golden.shots.clear();
+    golden.fireRate = -1.0f;
+    golden.minThroughput = 0.0;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        AsgStatsSample shot;
+        shot.deltaTime = -1.0f;
 
+        if (line[0] == '#')
+            golden.comments.push_back(line);
+        else if (sscanf(line, "shot %lf %f", &shot.position, &shot.velocity) == 2)
+            golden.shots.push_back(shot);
+        else if (sscanf(line, "fire_rate %f", &golden.fireRate) == 1)
+            continue;
+        else if (sscanf(line, "min_relative_throughput %lf", &golden.minThroughput) == 1)
+            continue;
+    }
+
+    fclose(file);
+    return true;
+}
+
+bool SaveGolden(const std::string& path, const Golden& golden)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    for (size_t i = 0; i < golden.comments.size(); ++i)
+        fputs(golden.comments[i].c_str(), file);
+
+    fprintf(file, "min_relative_throughput %.3f\n", golden.minThroughput);
+    fprintf(file, "fire_rate %.3f\n", golden.fireRate);
+    for (size_t i = 0; i < golden.shots.size(); ++i)
+        fprintf(file, "shot %.2f %.3f\n", golden.shots[i].position, golden.shots[i].velocity);
+
+    fclose(file);
+    return true;
+}
+
+bool IsClose(float value, float expected, float tolerance)
+{
+    if (value <= 0.0f || expected <= 0.0f)
+        return (value <= 0.0f) == (expected <= 0.0f);  // both undefined
+    return fabsf(value - expected) <= tolerance * expected;
+}
+
+// Tests ==========================================================================================
+
+void TestGolden(const char* name, bool record)
+{
     printf("======= %s test =======\n", name);
 
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
     AsgCounter counter;
-    for (;;)
+    Analyze(counter, samples);
+    const AsgStats& stats = counter.GetStats();
+    stats.Print();
+
+    double throughput;
+    double relativeThroughput = MeasureRelativeThroughput(samples, stats.history.GetSize(), throughput);
+    printf("Throughput = %.0f Msamples/s (%.3f of the scalar pass)\n", throughput, relativeThroughput);
+
+    std::string goldenPath = testsDir + name + ".golden";
+    Golden golden;
+    bool loaded = LoadGolden(goldenPath, golden);
+
+    if (record)
+    {
+        if (!loaded)
+            golden.comments.push_back(std::string("# Expected results for ") + name + ".raw (default config)\n");
+        stats.history.CopyTo(golden.shots);
+        golden.fireRate = stats.fireRateAvg;
+        golden.minThroughput = relativeThroughput * RECORDED_THROUGHPUT_RATIO;
+        if (!SaveGolden(goldenPath, golden))
+            Fail("can't write %s", goldenPath.c_str());
+        printf("Recorded %s\n\n", goldenPath.c_str());
+        return;
+    }
+
+    if (!loaded)
+    {
+        Fail("can't read %s", goldenPath.c_str());
+        return;
+    }
+
+    int failuresBefore = failuresNum;
+
+    // match the shots by position
+    std::vector<AsgStatsSample> detected;
+    stats.history.CopyTo(detected);
+    std::vector<bool> matched(detected.size(), false);
+    for (size_t i = 0; i < golden.shots.size(); ++i)
     {
-        size_t read = fread(buffer, sizeof(float), bufferSize, file);
-        if (read <= 0)
+        const AsgStatsSample& expected = golden.shots[i];
+
+        size_t found = detected.size();
+        for (size_t j = 0; j < detected.size() && found == detected.size(); ++j)
+        {
+            if (!matched[j] && fabs(detected[j].position - expected.position) <= POSITION_TOLERANCE)
+                found = j;
+        }
+
+        if (found == detected.size())
+        {
+            Fail("shot #%i at %.2f (%.3f m/s) missed", (int)i, expected.position, expected.velocity);
+            continue;
+        }
+
+        matched[found] = true;
+        if (!IsClose(detected[found].velocity, expected.velocity, VELOCITY_TOLERANCE))
+        {
+            Fail("shot #%i velocity is %.3f m/s, expected %.3f m/s", (int)i, detected[found].velocity,
+                 expected.velocity);
+        }
+    }
+
+    for (size_t j = 0; j < detected.size(); ++j)
+    {
+        if (!matched[j])
+            Fail("unexpected shot at %.2f (%.3f m/s)", detected[j].position, detected[j].velocity);
+    }
+
+    if (!IsClose(stats.fireRateAvg, golden.fireRate, FIRE_RATE_TOLERANCE))
+        Fail("fire rate is %.3f, expected %.3f", stats.fireRateAvg, golden.fireRate);
+
+#ifndef _DEBUG
+    if (relativeThroughput < golden.minThroughput)
+        Fail("relative throughput %.3f is below %.3f", relativeThroughput, golden.minThroughput);
+#endif
+
+    printf("%s\n\n", failuresNum == failuresBefore ? "OK" : "FAILED");
+}
+
+// compare chunked parallel analysis with the sequential one
+void TestParallel(const char* name, size_t chunkSize)
+{
+    printf("======= %s parallel test (chunk = %i) =======\n", name, (int)chunkSize);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
+    AsgCounter counter;
+    counter.ProcessBuffer(samples.data(), samples.size());
+    const AsgStats& expected = counter.GetStats();
+
+    AsgParallelAnalyzer analyzer(4);
+    analyzer.SetChunkSize(chunkSize);
+    analyzer.Analyze(samples.data(), samples.size());
+    const AsgStats& stats = analyzer.GetStats();
+
+    bool same = stats.history.GetSize() == expected.history.GetSize();
+    for (size_t i = 0; same && i < stats.history.GetSize(); ++i)
+    {
+        same = stats.history[i].position == expected.history[i].position &&
+            stats.history[i].velocity == expected.history[i].velocity &&
+            stats.history[i].deltaTime == expected.history[i].deltaTime;
+    }
+
+    if (!same)
+        Fail("parallel analysis differs from the sequential one");
+
+    printf("%s (%i shots, %i chunks reanalyzed)\n\n", same ? "OK" : "FAILED", (int)stats.shotsNum,
+           (int)analyzer.GetReanalyzedChunksNum());
+}
+
+// back-to-back jobs of different sizes, every index of a job runs once with that job's task
+void TestWorkerPool()
+{
+    printf("======= worker pool test =======\n");
+
+    const size_t JOBS_NUM = 2000;
+    const size_t MAX_TASKS_NUM = 8;
+    AsgWorkerPool pool(4);
+    std::vector<std::atomic<int>> runs(JOBS_NUM * MAX_TASKS_NUM);
+    for (std::atomic<int>& run : runs)
+        run = 0;
+    std::atomic<int> wrongRuns(0);
+
+    int failuresBefore = failuresNum;
+    for (size_t job = 0; job < JOBS_NUM; ++job)
+    {
+        const size_t tasksNum = 2 + job % (MAX_TASKS_NUM - 1);
+        pool.ParallelFor(tasksNum, [&, job, tasksNum](size_t i)
+        {
+            if (i < tasksNum)
+                runs[job * MAX_TASKS_NUM + i]++;
+            else
+                wrongRuns++;
+        });
+    }
+
+    int missedRuns = 0;
+    for (size_t job = 0; job < JOBS_NUM; ++job)
+    {
+        const size_t tasksNum = 2 + job % (MAX_TASKS_NUM - 1);
+        for (size_t i = 0; i < MAX_TASKS_NUM; ++i)
+            missedRuns += runs[job * MAX_TASKS_NUM + i] != (i < tasksNum ? 1 : 0) ? 1 : 0;
+    }
+    if (missedRuns > 0 || wrongRuns > 0)
+        Fail("%i tasks not run once, %i run with a wrong index", missedRuns, (int)wrongRuns);
+
+    printf("%s (%i jobs)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED", (int)JOBS_NUM);
+}
+
+// every reader of the shot events gets all the shots of the stats history, or counts them as lost
+void TestEventQueue(const char* name)
+{
+    printf("======= %s event queue test =======\n", name);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
+    const size_t SMALL_CAPACITY = 2;
+    AsgShotEventQueue queue(64);
+    AsgShotEventQueue smallQueue(SMALL_CAPACITY);
+    AsgShotEventQueue::Reader readers[2] = {queue.CreateReader(), queue.CreateReader()};
+    AsgShotEventQueue::Reader smallReader = smallQueue.CreateReader();
+
+    AsgCounter counter;
+    counter.SetCallback([&](const AsgShotEvent& event)
+    {
+        queue.Push(event);
+        smallQueue.Push(event);
+    });
+    Analyze(counter, samples);
+    std::vector<AsgStatsSample> history;
+    counter.GetStats().history.CopyTo(history);
+
+    int failuresBefore = failuresNum;
+    for (AsgShotEventQueue::Reader& reader : readers)
+    {
+        AsgShotEvent event;
+        size_t eventsNum = 0;
+        while (queue.Pop(reader, event))
+        {
+            if (eventsNum < history.size() &&
+                (event.index != eventsNum || event.firstPeak != history[eventsNum].position ||
+                 event.velocity != history[eventsNum].velocity || event.deltaTime != history[eventsNum].deltaTime))
+                Fail("event #%i differs from the stats history", (int)eventsNum);
+            eventsNum++;
+        }
+
+        if (eventsNum != history.size() || reader.GetLostNum() != 0)
+            Fail("%i events received, %i shots detected", (int)eventsNum, (int)history.size());
+    }
+
+    AsgShotEvent events[16];
+    size_t eventsNum = smallQueue.Pop(smallReader, events, 16);
+    size_t expectedNum = std::min(history.size(), SMALL_CAPACITY);
+    if (eventsNum != expectedNum || smallReader.GetLostNum() != history.size() - expectedNum ||
+        (eventsNum > 0 && events[eventsNum - 1].index != history.size() - 1))
+        Fail("%i events received, %i lost from the small queue", (int)eventsNum, (int)smallReader.GetLostNum());
+
+    printf("%s (%i shots)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED", (int)history.size());
+}
+
+// bounded history keeps the last shots and spills the older ones, the statistics are not affected
+void TestHistory(const char* name, size_t historySize)
+{
+    printf("======= %s history test (size = %i) =======\n", name, (int)historySize);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
+    AsgCounter fullCounter;
+    Analyze(fullCounter, samples);
+    const AsgStats& full = fullCounter.GetStats();
+
+    std::vector<AsgStatsSample> spilled;
+    AsgCounter counter;
+    counter.GetConfig().historySize = historySize;
+    counter.Reset();
+    counter.GetStats().history.SetSpillCallback([&](uint64_t, const AsgStatsSample& sample) { spilled.push_back(sample); });
+    Analyze(counter, samples);
+    const AsgStats& stats = counter.GetStats();
+
+    int failuresBefore = failuresNum;
+
+    // whole history is either kept or spilled
+    size_t fullSize = full.history.GetSize();
+    if (stats.history.GetSize() != std::min(fullSize, historySize) || spilled.size() + stats.history.GetSize() != fullSize)
+        Fail("%i shots kept, %i spilled, %i detected", (int)stats.history.GetSize(), (int)spilled.size(), (int)fullSize);
+
+    for (size_t i = 0; i < fullSize && failuresNum == failuresBefore; ++i)
+    {
+        const AsgStatsSample& sample = i < spilled.size() ? spilled[i] : stats.history[i - spilled.size()];
+        if (sample.position != full.history[i].position || sample.velocity != full.history[i].velocity)
+            Fail("shot #%i differs from the full history", (int)i);
+    }
+
+    // session statistics match, whole history window reproduces them
+    AsgStatsSummary window = full.GetSummary(fullSize, counter.GetConfig());
+    if (stats.velocityAvg != full.velocityAvg || stats.fireRateAvg != full.fireRateAvg ||
+        window.velocityAvg != full.velocityAvg || window.velocityStdDev != full.velocityStdDev ||
+        window.fireRateAvg != full.fireRateAvg || window.fireRateMax != full.fireRateMax)
+        Fail("statistics differ");
+
+    // window since the last pause updated incrementally (as the GUI does for magazines) matches the replayed one
+    const float PAUSE = 1.0f;
+    AsgStats pauseWindow;
+    for (size_t i = 0; i < fullSize; ++i)
+    {
+        const AsgStatsSample& sample = full.history[i];
+        if (sample.deltaTime < 0.0f || sample.deltaTime > PAUSE)
+            pauseWindow.Reset();
+        pauseWindow.AddSummarySample(sample.velocity, pauseWindow.shotsNum > 0 ? sample.deltaTime : -1.0f,
+                                     counter.GetConfig());
+    }
+    AsgStatsSummary replayed = full.GetSummary(full.CountShotsSincePause(PAUSE), counter.GetConfig());
+    if (pauseWindow.shotsNum != replayed.shotsNum || pauseWindow.velocityAvg != replayed.velocityAvg ||
+        pauseWindow.fireRateAvg != replayed.fireRateAvg)
+        Fail("incremental window of %i shots differs from the replayed one of %i shots", (int)pauseWindow.shotsNum,
+             (int)replayed.shotsNum);
+
+    printf("%s (%i shots kept, %i spilled)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED",
+           (int)stats.history.GetSize(), (int)spilled.size());
+}
+
+bool IsSameLoggedShot(const AsgLoggedShot& shot, uint64_t index, const AsgStatsSample& expected)
+{
+    // positions are stored with 1/256 sample precision, velocities in cm/s
+    return shot.index == index && fabs(shot.sample.position - expected.position) <= 1.0 / 512 &&
+           fabsf(shot.sample.velocity - expected.velocity) <= 0.005f &&
+           fabsf(shot.sample.deltaTime - expected.deltaTime) <= 1.0e-6f;
+}
+
+// shots logged from the detector are read back, queries skip to the right blocks
+void TestShotLog(const char* name)
+{
+    printf("======= %s shot log test =======\n", name);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
+    int failuresBefore = failuresNum;
+
+    AsgCounter counter;
+    AsgShotLogWriter writer;
+    if (!writer.Open(SHOT_LOG_PATH, counter.GetConfig()))
+    {
+        Fail("can't create %s", SHOT_LOG_PATH);
+        return;
+    }
+    counter.SetCallback([&](const AsgShotEvent& event) { writer.Push(event); });
+    Analyze(counter, samples);
+    writer.Close();
+
+    std::vector<AsgStatsSample> history;
+    counter.GetStats().history.CopyTo(history);
+
+    AsgShotLogReader reader;
+    std::vector<AsgLoggedShot> shots;
+    if (!reader.Open(SHOT_LOG_PATH) || !reader.ReadShots(0, UINT64_MAX, shots))
+        Fail("can't read %s", SHOT_LOG_PATH);
+    else if (shots.size() != history.size() || reader.GetConfig().sampleRate != counter.GetConfig().sampleRate)
+        Fail("%i shots logged, %i detected", (int)shots.size(), (int)history.size());
+
+    for (size_t i = 0; i < shots.size() && failuresNum == failuresBefore; ++i)
+    {
+        if (!IsSameLoggedShot(shots[i], i, history[i]))
+            Fail("logged shot #%i differs from the stats history", (int)i);
+    }
+
+    // bounded history spilling to the log, the kept shots are added at the end of the session
+    const size_t SPILL_HISTORY_SIZE = 3;
+    AsgCounter spillCounter;
+    spillCounter.GetConfig().historySize = SPILL_HISTORY_SIZE;
+    spillCounter.Reset();
+    AsgShotLogWriter spillWriter;
+    spillWriter.Open(SHOT_LOG_PATH, spillCounter.GetConfig());
+    spillCounter.GetStats().history.SetSpillCallback([&](uint64_t index, const AsgStatsSample& sample)
+    {
+        spillWriter.Push(index, sample);
+    });
+    Analyze(spillCounter, samples);
+    spillWriter.PushHistory(spillCounter.GetStats().history);
+    spillWriter.Close();
+
+    shots.clear();
+    if (!reader.Open(SHOT_LOG_PATH) || !reader.ReadShots(0, UINT64_MAX, shots) || shots.size() != history.size())
+        Fail("%i shots in the spill log, %i detected", (int)shots.size(), (int)history.size());
+    for (size_t i = 0; i < shots.size() && failuresNum == failuresBefore; ++i)
+    {
+        if (!IsSameLoggedShot(shots[i], i, history[i]))
+            Fail("spilled shot #%i differs from the stats history", (int)i);
+    }
+
+    // log finished without waiting and re-enabled in the same session, the shots logged before
+    // aren't logged again
+    const AsgShotHistory& spillHistory = spillCounter.GetStats().history;
+    const uint64_t loggedNum = spillHistory.GetDroppedNum() + spillHistory.GetSize() - 1;
+    spillWriter.Open(SHOT_LOG_PATH, spillCounter.GetConfig());
+    spillWriter.Finish(spillHistory, loggedNum);
+    if (spillWriter.IsOpen())
+        Fail("finished log still open");
+    spillWriter.Close();
+
+    shots.clear();
+    // the interval to the shot before the log is unknown
+    if (!reader.Open(SHOT_LOG_PATH) || !reader.ReadShots(0, UINT64_MAX, shots) || shots.size() != 1 ||
+        shots[0].index != loggedNum || fabs(shots[0].sample.position - history.back().position) > 1.0 / 512)
+        Fail("%i shots in the re-enabled log, 1 expected", (int)shots.size());
+
+    // long session with a gap (shots dropped by the writer), spanning many blocks
+    const uint64_t SHOTS_NUM = 5000, GAP_BEGIN = 2100, GAP_END = 2110;
+    std::vector<AsgStatsSample> expected;
+    AsgShotLogWriter longWriter(SHOTS_NUM);
+    longWriter.Open(SHOT_LOG_PATH, counter.GetConfig());
+    double position = 1000.25;
+    for (uint64_t i = 0; i < SHOTS_NUM; ++i)
+    {
+        AsgStatsSample sample;
+        sample.velocity = (i % 7 == 3) ? -1.0f : 80.0f + (i * 37 % 50);
+        sample.deltaTime = (i == 0 || i == GAP_END) ? -1.0f : 1000.5f / counter.GetConfig().sampleRate;
+        sample.position = position;
+        position += 1000.5;
+        expected.push_back(sample);
+
+        if (i >= GAP_BEGIN && i < GAP_END)
+            continue;
+
+        AsgShotEvent event = AsgShotEvent();
+        event.index = i;
+        event.firstPeak = sample.position;
+        event.velocity = sample.velocity;
+        longWriter.Push(event);
+    }
+    longWriter.Close();
+
+    if (!reader.Open(SHOT_LOG_PATH) || reader.GetShotsNum() != SHOTS_NUM)
+        Fail("can't read the long log");
+
+    const uint64_t FIRST = 2000, COUNT = 1000;
+    const float MIN_VELOCITY = 125.0f;
+    shots.clear();
+    reader.ReadShots(FIRST, COUNT, shots, MIN_VELOCITY);
+
+    size_t shotId = 0;
+    for (uint64_t i = FIRST; i < FIRST + COUNT; ++i)
+    {
+        if ((i >= GAP_BEGIN && i < GAP_END) || expected[i].velocity < MIN_VELOCITY)
+            continue;
+        if (shotId >= shots.size() || !IsSameLoggedShot(shots[shotId], i, expected[i]))
+        {
+            Fail("long log shot #%i not found", (int)i);
             break;
+        }
+        shotId++;
+    }
+    if (shotId != shots.size())
+        Fail("%i shots selected, %i expected", (int)shots.size(), (int)shotId);
+
+    reader.Close();
+    remove(SHOT_LOG_PATH);
+
+    printf("%s (%i shots)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED", (int)history.size());
+}
+
+bool WriteCompressed(const std::vector<float>& samples, int bitsPerSample, uint64_t& bytesNum, uint64_t& inexactNum)
+{
+    // odd chunk and write sizes, so the last chunk is partial and writes span chunks
+    const size_t CHUNK_FRAMES = 3000, WRITE_FRAMES = 4999;
+    AsgCaptureWriter writer;
+    if (!writer.Open(COMPRESSED_PATH, 1, 44100.0f, bitsPerSample, CHUNK_FRAMES))
+        return false;
+
+    for (size_t pos = 0; pos < samples.size(); pos += WRITE_FRAMES)
+        writer.Write(samples.data() + pos, std::min(WRITE_FRAMES, samples.size() - pos));
+
+    bool ok = writer.Close();
+    bytesNum = writer.GetBytesNum();
+    inexactNum = writer.GetInexactNum();
+    return ok;
+}
+
+// overwrites a header field of the compressed capture and tries to open it, restores the field
+bool OpensWithHeaderField(long offset, uint64_t value, size_t size)
+{
+    FILE* file = fopen(COMPRESSED_PATH, "r+b");
+    if (file == nullptr)
+        return false;
+
+    uint8_t original[8], corrupted[8];
+    for (size_t i = 0; i < size; ++i)
+        corrupted[i] = static_cast<uint8_t>(value >> (8 * i));
+    fseek(file, offset, SEEK_SET);
+    bool ok = fread(original, 1, size, file) == size;
+    fseek(file, offset, SEEK_SET);
+    ok = ok && fwrite(corrupted, 1, size, file) == size;
+    fflush(file);
+
+    AsgCaptureDecoder decoder;
+    const bool opened = ok && decoder.Open(COMPRESSED_PATH);
+    decoder.Close();
+
+    fseek(file, offset, SEEK_SET);
+    fwrite(original, 1, size, file);
+    fclose(file);
+    return opened;
+}
 
-        counter.ProcessBuffer(buffer, read);
+// 16-bit samples are stored exactly, the float captures at 24 bits detect the same shots
+void TestCompressedCapture(const char* name)
+{
+    printf("======= %s compressed capture test =======\n", name);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
     }
 
-    AsgStats& stats = counter.GetStats();
+    int failuresBefore = failuresNum;
+    uint64_t bytesNum, inexactNum;
 
-    stats.Calc(counter.GetConfig());
-    stats.Print();
-    printf("\n");
+    std::vector<float> integers(samples.size());
+    for (size_t i = 0; i < samples.size(); ++i)
+        integers[i] = floorf(samples[i] * 32768.0f + 0.5f) / 32768.0f;
+
+    std::vector<float> decoded;
+    if (!WriteCompressed(integers, 16, bytesNum, inexactNum) || !ReadSamples(COMPRESSED_PATH, decoded))
+        Fail("can't write or read %s", COMPRESSED_PATH);
+    else if (inexactNum != 0 || decoded != integers)
+        Fail("16-bit samples differ after decoding");
+    const double ratio = static_cast<double>(samples.size() * sizeof(float)) / static_cast<double>(bytesNum);
+
+    // random access through the seek table
+    const uint64_t SEEK_POS = samples.size() * 2 / 3;
+    AsgCaptureReader reader;
+    const float* span;
+    if (!reader.Open(COMPRESSED_PATH) || !reader.Seek(SEEK_POS) || reader.Read(span, 10) != 10 ||
+        !std::equal(span, span + 10, integers.begin() + SEEK_POS))
+        Fail("seeking to sample %i failed", (int)SEEK_POS);
+    reader.Close();
+
+    if (!WriteCompressed(samples, 24, bytesNum, inexactNum) || !ReadSamples(COMPRESSED_PATH, decoded) ||
+        decoded.size() != samples.size())
+        Fail("can't write or read %s", COMPRESSED_PATH);
+    else
+    {
+        AsgCounter counter, decodedCounter;
+        Analyze(counter, samples);
+        Analyze(decodedCounter, decoded);
+
+        std::vector<AsgStatsSample> shots, decodedShots;
+        counter.GetStats().history.CopyTo(shots);
+        decodedCounter.GetStats().history.CopyTo(decodedShots);
+        if (shots.size() != decodedShots.size())
+            Fail("%i shots detected in the decoded capture, %i expected", (int)decodedShots.size(), (int)shots.size());
+
+        for (size_t i = 0; i < shots.size() && failuresNum == failuresBefore; ++i)
+        {
+            if (fabs(decodedShots[i].position - shots[i].position) > POSITION_TOLERANCE ||
+                !IsClose(decodedShots[i].velocity, shots[i].velocity, VELOCITY_TOLERANCE))
+                Fail("shot #%i differs in the decoded capture", (int)i);
+        }
+    }
+
+    // damaged headers are rejected before allocating anything for them
+    const long CHANNELS = 8, CHUNK_FRAMES = 16, FRAMES = 20, SEEK_TABLE = 28;
+    if (OpensWithHeaderField(CHANNELS, 0xffff, 2) || OpensWithHeaderField(CHUNK_FRAMES, 0xffffffff, 4) ||
+        OpensWithHeaderField(CHUNK_FRAMES, 1, 4) || OpensWithHeaderField(FRAMES, UINT64_MAX, 8) ||
+        OpensWithHeaderField(SEEK_TABLE, UINT64_MAX, 8) || OpensWithHeaderField(SEEK_TABLE, 0, 8))
+        Fail("compressed capture with a damaged header opened");
+    else if (!OpensWithHeaderField(CHANNELS, 1, 2))
+        Fail("compressed capture not opened after restoring the header");
+
+    remove(COMPRESSED_PATH);
+
+    printf("%s (16-bit %.2f times smaller)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED", ratio);
+}
+
+// config changed mid-stream keeps the statistics, the shots after the change are detected as with
+// the new config from the start
+void TestLiveConfig(const char* name)
+{
+    printf("======= %s live config test =======\n", name);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
+    AsgCounterConfig newConfig;
+    newConfig.blockSize = 1024;
+    newConfig.rmsWindow = 8192;
+    newConfig.noiseEstimator = AsgNoiseEstimator::Median;
+    newConfig.detectionSigma = 12.0f;
+    newConfig.historySize = 8;
+
+    AsgCounter oldCounter, newCounter;
+    Analyze(oldCounter, samples);
+    newCounter.GetConfig() = newConfig;
+    newCounter.GetConfig().historySize = 0;
+    Analyze(newCounter, samples);
+    std::vector<AsgStatsSample> oldShots, newShots;
+    oldCounter.GetStats().history.CopyTo(oldShots);
+    newCounter.GetStats().history.CopyTo(newShots);
+
+    if (oldShots.size() < 2)
+    {
+        Fail("%i shots detected", (int)oldShots.size());
+        return;
+    }
+
+    // switch between the shots in the middle, the new noise floor has time to settle before the next one
+    const size_t switchShot = oldShots.size() / 2;
+    const size_t switchPos = static_cast<size_t>(oldShots[switchShot - 1].position + oldShots[switchShot].position) / 2;
+
+    std::vector<AsgStatsSample> spilled;
+    AsgCounter counter;
+    counter.GetStats().history.SetSpillCallback([&](uint64_t, const AsgStatsSample& sample) { spilled.push_back(sample); });
+    for (size_t pos = 0; pos < samples.size(); pos += READ_SPAN)
+    {
+        size_t samplesNum = std::min(READ_SPAN, samples.size() - pos);
+        if (pos <= switchPos && switchPos < pos + samplesNum)
+        {
+            counter.ProcessBuffer(samples.data() + pos, switchPos - pos);
+            counter.SetConfig(newConfig);
+            counter.ProcessBuffer(samples.data() + switchPos, pos + samplesNum - switchPos);
+        }
+        else
+        {
+            counter.ProcessBuffer(samples.data() + pos, samplesNum);
+        }
+    }
+
+    const AsgStats& stats = counter.GetStats();
+    int failuresBefore = failuresNum;
+
+    if (counter.IsConfigPending() || counter.GetConfig().blockSize != newConfig.blockSize)
+        Fail("config not applied");
+
+    std::vector<AsgStatsSample> shots(spilled);
+    for (size_t i = 0; i < stats.history.GetSize(); ++i)
+        shots.push_back(stats.history[i]);
+
+    size_t expectedNum = switchShot;
+    for (const AsgStatsSample& shot : newShots)
+        expectedNum += shot.position > switchPos ? 1 : 0;
+
+    if (stats.shotsNum != shots.size() || shots.size() != expectedNum || stats.history.GetSize() > newConfig.historySize)
+        Fail("%i shots detected (%i kept), %i expected", (int)stats.shotsNum, (int)stats.history.GetSize(), (int)expectedNum);
+
+    for (size_t i = 0; i < shots.size() && failuresNum == failuresBefore; ++i)
+    {
+        const AsgStatsSample& expected = i < switchShot ? oldShots[i] : newShots[newShots.size() - (shots.size() - i)];
+        if (fabs(shots[i].position - expected.position) > POSITION_TOLERANCE ||
+            !IsClose(shots[i].velocity, expected.velocity, VELOCITY_TOLERANCE))
+            Fail("shot #%i differs (%.2f, expected %.2f)", (int)i, shots[i].position, expected.position);
+    }
+
+    // reset after assigning a config directly uses that one, not an older config still pending
+    AsgCounter resetCounter;
+    resetCounter.ProcessBuffer(samples.data(), static_cast<size_t>(oldShots[switchShot].position) + 10);
+    resetCounter.SetConfig(newConfig);
+    const bool pending = resetCounter.IsConfigPending();
+    AsgCounterConfig directConfig;
+    directConfig.detectionSigma = 9.0f;
+    resetCounter.GetConfig() = directConfig;
+    resetCounter.Reset();
+    if (!pending || resetCounter.IsConfigPending() || resetCounter.GetConfig().detectionSigma != directConfig.detectionSigma ||
+        resetCounter.GetConfig().blockSize != directConfig.blockSize)
+        Fail("reset applied the pending config");
+
+    printf("%s (%i shots, config changed at %i)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED",
+           (int)shots.size(), (int)switchPos);
+}
+
+// percentiles are exact for short sessions and within the rank error for long ones, also when merged
+void TestQuantileSketch(const char* name)
+{
+    printf("======= %s quantile sketch test =======\n", name);
+
+    std::vector<float> samples;
+    if (!ReadCapture(name, samples))
+    {
+        Fail("can't read %s%s.raw", testsDir.c_str(), name);
+        return;
+    }
+
+    AsgCounter counter;
+    Analyze(counter, samples);
+    const AsgStats& stats = counter.GetStats();
+
+    int failuresBefore = failuresNum;
+
+    std::vector<float> velocities;
+    for (size_t i = 0; i < stats.history.GetSize(); ++i)
+    {
+        if (stats.history[i].velocity > 0.0f)
+            velocities.push_back(stats.history[i].velocity);
+    }
+    std::sort(velocities.begin(), velocities.end());
+
+    if (velocities.empty() || stats.velocitySketch.GetCount() != velocities.size() ||
+        stats.velocitySketch.GetQuantile(0.0f) != velocities.front() ||
+        stats.velocitySketch.GetQuantile(0.5f) != velocities[(velocities.size() - 1) / 2] ||
+        stats.velocitySketch.GetQuantile(1.0f) != velocities.back())
+        Fail("velocity percentiles differ from the history");
+
+    // E = m * v^2 / 2, limit at the median
+    const float mass = counter.GetConfig().mass;
+    const float median = velocities[(velocities.size() - 1) / 2];
+    const size_t above = velocities.end() - std::upper_bound(velocities.begin(), velocities.end(), median);
+    const uint64_t counted = stats.CountShotsAboveEnergy(0.5f * mass * median * median * 1.0001f, mass);
+    if (counted != above)
+        Fail("%i shots counted above the energy limit, expected %i", (int)counted, (int)above);
+
+    // full-auto burst with intervals varying less than the fire rate treshold, every shot from the
+    // third one has its fire rate in the sketch
+    const size_t BURST_SHOTS = 1000;
+    const double MAX_RANK_ERROR = 0.02;
+    AsgStats burst;
+    std::vector<float> fireRates;
+    uint32_t random = 1;
+    for (size_t i = 0; i < BURST_SHOTS; ++i)
+    {
+        random = random * 1664525u + 1013904223u;
+        const float dt = 0.05f * (1.0f + 0.2f * static_cast<float>(random >> 8) / static_cast<float>(1 << 24));
+        burst.AddSummarySample(90.0f, i > 0 ? dt : -1.0f, counter.GetConfig());
+        if (i >= 2)
+            fireRates.push_back(1.0f / dt);
+    }
+    std::sort(fireRates.begin(), fireRates.end());
+
+    double fireRateError = 0.0;
+    for (float fraction : { 0.05f, 0.5f, 0.95f, 0.99f })
+    {
+        const float quantile = burst.fireRateSketch.GetQuantile(fraction);
+        const size_t rank = std::lower_bound(fireRates.begin(), fireRates.end(), quantile) - fireRates.begin();
+        fireRateError = std::max(fireRateError, fabs(static_cast<double>(rank) / fireRates.size() - fraction));
+    }
+    if (burst.fireRateSketch.GetCount() != fireRates.size() || fireRateError > MAX_RANK_ERROR)
+        Fail("fire rate percentiles of %i shots, rank error %.4f", (int)burst.fireRateSketch.GetCount(), fireRateError);
+
+    // several fractions in any order from one sort
+    const float fractions[] = { 0.99f, 0.0f, 0.5f, 1.0f, 0.05f };
+    float quantiles[5];
+    burst.fireRateSketch.GetQuantiles(fractions, quantiles, 5);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        if (quantiles[i] != burst.fireRateSketch.GetQuantile(fractions[i]))
+            Fail("fire rate quantile %.2f differs when computed with others", fractions[i]);
+    }
+
+    // long session of uniformly distributed values, half of them in another sketch merged later
+    const uint32_t VALUES_NUM = 1000000;
+    AsgQuantileSketch sketch, other;
+    random = 1;
+    for (uint32_t i = 0; i < VALUES_NUM; ++i)
+    {
+        random = random * 1664525u + 1013904223u;
+        float value = static_cast<float>(random >> 8) / static_cast<float>(1 << 24);
+        (i % 2 == 0 ? sketch : other).Add(value);
+    }
+
+    double maxError = 0.0;
+    for (int merged = 0; merged < 2; ++merged)
+    {
+        if (merged)
+            sketch.Merge(other);
+
+        const uint64_t count = sketch.GetCount();
+        for (float fraction = 0.01f; fraction < 1.0f; fraction += 0.01f)
+        {
+            double quantileError = fabs(sketch.GetQuantile(fraction) - fraction);
+            double rankError = fabs(static_cast<double>(sketch.GetRank(fraction)) / count - fraction);
+            maxError = std::max(maxError, std::max(quantileError, rankError));
+        }
+
+        if (count != (merged ? VALUES_NUM : VALUES_NUM / 2))
+            Fail("%i values counted", (int)count);
+    }
+
+    if (maxError > MAX_RANK_ERROR)
+        Fail("rank error %.4f", maxError);
+
+    printf("%s (%i velocities, rank error %.4f)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED",
+           (int)velocities.size(), maxError);
+}
+
+// every thread keeps its last events, the export has them all (also after the thread ended); threads
+// started one after another share a ring
+void TestTrace()
+{
+    printf("======= trace test =======\n");
+
+    const size_t EXTRA_EVENTS = 100, THREADS_NUM = 3;
+    for (size_t t = 0; t < THREADS_NUM; ++t)
+    {
+        std::thread thread([&]
+        {
+            AsgTrace::SetThreadName("Test \"quoted\"");
+            for (size_t i = 0; i < AsgTrace::TRACE_RING_SIZE + EXTRA_EVENTS; ++i)
+                AsgTrace::AddSpan("TestSpan", i * 1000, i * 1000 + 500);
+            AsgTrace::AddCounter("TestCounter", 42);
+        });
+        thread.join();
+    }
+
+    int failuresBefore = failuresNum;
+    if (!AsgTrace::Export(TRACE_PATH))
+        Fail("can't write %s", TRACE_PATH);
+
+    size_t spansNum = 0, countersNum = 0, namesNum = 0, threadsNum = 0;
+    FILE* file = fopen(TRACE_PATH, "r");
+    char line[256];
+    while (file != nullptr && fgets(line, sizeof(line), file))
+    {
+        spansNum += strstr(line, "\"TestSpan\", \"ph\": \"X\"") != nullptr ? 1 : 0;
+        countersNum += strstr(line, "\"TestCounter\", \"ph\": \"C\"") != nullptr ? 1 : 0;
+        namesNum += strstr(line, "\"name\": \"Test \\\"quoted\\\"\"") != nullptr ? 1 : 0;
+        threadsNum += strstr(line, "\"thread_name\"") != nullptr ? 1 : 0;
+    }
+    if (file != nullptr)
+        fclose(file);
+    remove(TRACE_PATH);
+
+    // the oldest spans were overwritten by the newer ones and the counter
+    if (spansNum != AsgTrace::TRACE_RING_SIZE - 1 || countersNum != 1 || namesNum != 1 || threadsNum != 1)
+    {
+        Fail("%i spans, %i counters, %i thread names of %i threads exported", (int)spansNum, (int)countersNum,
+             (int)namesNum, (int)threadsNum);
+    }
+
+    printf("%s (%i spans)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED", (int)spansNum);
+}
+
+// small values are exact, percentiles of larger ones are within the bucket width
+void TestLatencyHistogram()
+{
+    printf("======= latency histogram test =======\n");
+
+    int failuresBefore = failuresNum;
+    AsgLatencyHistogram exact;
+    for (uint64_t value = 1; value <= 100; ++value)
+        exact.Record(value);
+    if (exact.GetPercentile(0.5) != 50 || exact.GetPercentile(0.99) != 99 || exact.GetPercentile(1.0) != 100)
+        Fail("exact percentiles %i / %i / %i", (int)exact.GetPercentile(0.5), (int)exact.GetPercentile(0.99),
+             (int)exact.GetPercentile(1.0));
+
+    // log-uniform latencies from 1 us to 1 s, half of them in each histogram
+    const double MAX_RELATIVE_ERROR = 1.0 / 64.0;
+    std::vector<uint64_t> values;
+    AsgLatencyHistogram first, second;
+    uint32_t random = 12345;
+    for (int i = 0; i < 100000; ++i)
+    {
+        random = random * 1664525u + 1013904223u;
+        const uint64_t value = static_cast<uint64_t>(1000.0 * pow(10.0, 6.0 * random / 4294967296.0));
+        values.push_back(value);
+        (i % 2 == 0 ? first : second).Record(value);
+    }
+    first.Merge(second);
+    std::sort(values.begin(), values.end());
+
+    double maxError = 0.0;
+    for (double fraction : { 0.01, 0.1, 0.5, 0.9, 0.99, 0.999 })
+    {
+        const uint64_t expected = values[static_cast<size_t>(ceil(fraction * values.size())) - 1];
+        const double error = fabs(static_cast<double>(first.GetPercentile(fraction)) - expected) / expected;
+        maxError = std::max(maxError, error);
+    }
+    if (maxError > MAX_RELATIVE_ERROR)
+        Fail("relative error %.4f", maxError);
+    if (first.GetCount() != values.size() || first.GetMax() != values.back() || first.GetPercentile(1.0) != values.back())
+        Fail("count %i, max %i", (int)first.GetCount(), (int)first.GetMax());
+
+    printf("%s (relative error %.4f)\n\n", failuresNum == failuresBefore ? "OK" : "FAILED", maxError);
 }
 
-int main()
+int main(int argc, char** argv)
 {
-    LARGE_INTEGER start, stop, freq;
-    QueryPerformanceFrequency(&freq);
+    bool record = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--record") == 0)
+            record = true;
+        else if (strcmp(argv[i], "--tests") == 0 && i + 1 < argc)
+            testsDir = std::string(argv[++i]) + "/";
+    }
 
-    QueryPerformanceCounter(&start);
+    for (const char* name : CAPTURES)
+        TestGolden(name, record);
 
-    //Test("TestSample");
-    //Test("AK");
-    Test("G36");
-    //Test("G36_rev");
-    //Test("digl");
+    if (!record)
+    {
+        TestParallel("digl", 1);
+        TestParallel("digl", 50000);
+        TestParallel("G36", 1);
+        TestParallel("G36", 50000);
+        TestWorkerPool();
+        TestEventQueue("G36");
+        TestHistory("digl", 4);
+        TestHistory("G36_rev", 100);
+        TestShotLog("G36_rev");
+        TestCompressedCapture("digl");
+        TestCompressedCapture("G36");
+        TestLiveConfig("G36");
+        TestLiveConfig("digl");
+        TestQuantileSketch("G36");
+        TestTrace();
+        TestLatencyHistogram();
+    }
 
-    QueryPerformanceCounter(&stop);
-    printf("Time = %.3f ms\n", (float)(stop.QuadPart - start.QuadPart) / (float)freq.QuadPart);
+    if (failuresNum > 0)
+        printf("%i check(s) FAILED\n", failuresNum);
+    else
+        printf("All tests passed\n");
 
-    system("pause");
-    return 0;
+    return failuresNum > 0 ? 1 : 0;
 }
@@ -1,10 +1,13 @@
 #pragma once
 
 #include <stdio.h>
-#include <tchar.h>
 #include <stdlib.h>
-#include <assert.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
 
 #include <vector>
 #include <string>
+#include <chrono>
+#include <algorithm>
 #include <functional>
\ No newline at end of file
@@ -1,3 +1,13 @@
 #pragma once
 
-#define METERS_TO_FEET 3.2808f
\ No newline at end of file
+#define METERS_TO_FEET 3.2808f
+
+// low latency detection mode parameters (in seconds)
+#define LOW_LATENCY_BLOCK_TIME 0.005f
+#define LOW_LATENCY_RMS_WINDOW_TIME 0.5f
+
+// shots kept by the detector for the windowed statistics
+#define STATS_HISTORY_SIZE 4096
+
+// pause between shots (in seconds) taken for a magazine change
+#define MAGAZINE_CHANGE_TIME 5.0f
\ No newline at end of file
@@ -2,17 +2,59 @@
 #include "Common.h"
 #include "SetupComponent.h"
 
+namespace {
+
+const size_t SAMPLES_RING_SIZE = 256 * 1024;  // over 1 second at 192 kHz
+const size_t SHOTS_RING_SIZE = 1024;
+const size_t DETECTOR_CHUNK_SIZE = 4096;
+const size_t SHOT_LOG_QUEUE_SIZE = 2 * STATS_HISTORY_SIZE;  // shots spilled while the log thread sleeps
+
+// audio callback times kept for finding the callback of a shot, the ring is over 1 second of
+// callbacks of 256 samples at 192 kHz, the detector keeps a few seconds
+const size_t CALLBACK_TIMES_RING_SIZE = 1024;
+const size_t RECENT_CALLBACKS_NUM = 4096;
+
+} // namespace
+
 MeasureComponent::MeasureComponent(AudioDeviceManager* audioDeviceManager)
     : audioDeviceManager(audioDeviceManager)
+    , pushedSamples(0)
+    , samplesRing(SAMPLES_RING_SIZE)
+    , callbackTimes(CALLBACK_TIMES_RING_SIZE)
+    , droppedSamples(0)
+    , shotsQueue(SHOTS_RING_SIZE)
+    , settingsValid(false)
+    , requestedVersion(0)
+    , requestedGeneration(0)
+    , requestedShotLog(false)
+    , detectorRunning(true)
+    , configVersion(0)
+    , generation(0)
+    , poppedSamples(0)
+    , recentCallbacks(RECENT_CALLBACKS_NUM)
+    , recentCallbacksPos(0)
+    , shotLog(SHOT_LOG_QUEUE_SIZE)
+    , loggedShotsNum(0)
+    , shotLogFinishing(false)
+    , lostShots(0)
+    , shownGeneration(0)
+    , energyLimit(0.0f)
+    , historyVersion(0)
+    , shownHistoryVersion(0)
     , font(Font::getDefaultMonospacedFontName(), 24.0f, Font::bold)
+    , historyFont(Font::getDefaultMonospacedFontName(), 14.0f, Font::plain)
+    , historyList("History", this)
 {
     advancedView = true;
 
-    addAndMakeVisible(historyTextBox);
-    historyTextBox.setReadOnly(true);
-    historyTextBox.setMultiLine(true);
-    historyTextBox.setColour(TextEditor::outlineColourId, Colours::grey);
-    historyTextBox.setFont(Font(Font::getDefaultMonospacedFontName(), 14.0f, Font::plain));
+    addAndMakeVisible(historyHeaderLabel);
+    historyHeaderLabel.setText("#ID      FPS      RoF", dontSendNotification);
+    historyHeaderLabel.setFont(historyFont);
+
+    addAndMakeVisible(historyList);
+    historyList.setRowHeight(static_cast<int>(historyFont.getHeight()) + 2);
+    historyList.setColour(ListBox::outlineColourId, Colours::grey);
+    historyList.setOutlineThickness(1);
 
     addAndMakeVisible(clearButton = new TextButton("Clear", "Begin a new measurement"));
     clearButton->addListener(this);
@@ -21,10 +63,17 @@ MeasureComponent::MeasureComponent(AudioDeviceManager* audioDeviceManager)
     advancedViewButton.setButtonText("Advanced view");
     advancedViewButton.addListener(this);
 
+    addChildComponent(saveTraceButton);
+    saveTraceButton.setButtonText("Save trace");
+    saveTraceButton.setTooltip("Save the recorded hot path timings for chrome://tracing or Perfetto");
+    saveTraceButton.addListener(this);
+    saveTraceButton.setVisible(AsgTrace::IsCompiledIn());
+
     addAndMakeVisible(velocityTitleLabel);
     addAndMakeVisible(velocityLabel);
     velocityTitleLabel.setText("Velocity [ft/s]:", dontSendNotification);
     velocityLabel.setFont(font);
+    velocityLabel.onPaint = std::bind(&MeasureComponent::OnVelocityPainted, this);
 
     addAndMakeVisible(rofTitleLabel);
     addAndMakeVisible(rofLabel);
@@ -39,14 +88,42 @@ MeasureComponent::MeasureComponent(AudioDeviceManager* audioDeviceManager)
 
     Reset();
 
+    counter.GetConfig().historySize = STATS_HISTORY_SIZE;
+    counter.Reset();
+    requestedConfig = counter.GetConfig();
+    counter.SetCallback(std::bind(&MeasureComponent::OnAsgEvent, this, std::placeholders::_1));
+    counter.GetStats().history.SetSpillCallback([this](uint64_t index, const AsgStatsSample& sample)
+    {
+        if (shotLog.IsOpen() && index >= loggedShotsNum)
+            shotLog.Push(index, sample);
+    });
+    detectedShots.reserve(SHOTS_RING_SIZE);
+    undisplayedShots.reserve(SHOTS_RING_SIZE);
+    shotsReader = shotsQueue.CreateReader();
+    PublishState();
+    detectorThread = std::thread(&MeasureComponent::DetectorThreadMain, this);
+
     audioDeviceManager->addAudioCallback(this);
-    counter.SetCallback(std::bind(&MeasureComponent::OnAsgEvent, this));
     startTimer(200);
 }
 
 MeasureComponent::~MeasureComponent()
 {
     audioDeviceManager->removeAudioCallback(this);
+
+    detectorRunning = false;
+    detectorThread.join();
+    cancelPendingUpdate();
+    CloseShotLog();
+    JoinShotLog();
+
+    if (displayLatency.GetCount() > 0)
+    {
+        Logger::writeToLog("Shot latency since the audio callback:\n" +
+                           FormatLatency("Detection", detectionLatency) +
+                           FormatLatency("Publication", publicationLatency) +
+                           FormatLatency("Display", displayLatency));
+    }
 }
 
 // overrides AudioIODeviceCallback ============================================================
@@ -54,7 +131,12 @@ MeasureComponent::~MeasureComponent()
 void MeasureComponent::audioDeviceAboutToStart(AudioIODevice* device)
 {
     sampleRate = device->getCurrentSampleRate();
-    counter.GetConfig().sampleRate = sampleRate;
+
+    // peak distances are in samples, so they have to follow the sample rate
+    std::unique_lock<std::mutex> lock(requestLock);
+    requestedConfig.sampleRate = static_cast<float>(sampleRate);
+    BuildConfigLocked();
+    PublishRequestLocked();
 }
 
 void MeasureComponent::audioDeviceStopped()
@@ -66,23 +148,36 @@ void MeasureComponent::audioDeviceIOCallback(const float** inputChannelData, int
                                              float** outputChannelData, int numOutputChannels,
                                              int numSamples)
 {
+    ASG_TRACE_THREAD_NAME("Audio");
+    ASG_TRACE_SCOPE("AudioCallback");
+    const uint64_t callbackStartTime = AsgTrace::GetTime();
+
     if (buffer.size() < numSamples)
         buffer.resize(numSamples + 256);
 
-    for (int i = 0; i < numSamples; ++i)
     {
-        float inputSample = 0.0f;
-        for (int chan = 0; chan < numInputChannels; ++chan)
-            if (const float* inputChannel = inputChannelData[chan])
-                inputSample += inputChannel[i];
-        buffer[i] = inputSample;
+        ASG_TRACE_SCOPE("Mixdown");
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float inputSample = 0.0f;
+            for (int chan = 0; chan < numInputChannels; ++chan)
+                if (const float* inputChannel = inputChannelData[chan])
+                    inputSample += inputChannel[i];
+            buffer[i] = inputSample;
+        }
     }
 
-    // TODO: this should be done on a separate thread
-    {
-        std::unique_lock<std::mutex> lock(asgStatsLock);
-        counter.ProcessBuffer(buffer.data(), numSamples);
-    }
+    // detection is done on the detector thread, never block here
+    size_t pushed = samplesRing.Push(buffer.data(), numSamples);
+    if (pushed < static_cast<size_t>(numSamples))
+        droppedSamples += numSamples - pushed;
+
+    pushedSamples += pushed;
+    CallbackTime callbackTime;
+    callbackTime.endPos = pushedSamples;
+    callbackTime.time = callbackStartTime;
+    callbackTimes.Push(callbackTime);
+    ASG_TRACE_COUNTER("SamplesQueued", samplesRing.GetSize());
 
     // we need to clear the output buffers, in case they're full of junk...
     for (int i = 0; i < numOutputChannels; ++i)
@@ -97,8 +192,8 @@ void MeasureComponent::buttonClicked(Button* button)
     if (button == clearButton)
     {
         {
-            std::unique_lock<std::mutex> lock(asgStatsLock);
-            counter.Reset();
+            std::unique_lock<std::mutex> lock(requestLock);
+            RequestResetLocked();
         }
 
         Reset();
@@ -109,6 +204,18 @@ void MeasureComponent::buttonClicked(Button* button)
         advancedView = advancedViewButton.getToggleState();
         advancedViewTextBox.setVisible(advancedView);
     }
+
+    if (button == &saveTraceButton)
+    {
+        FileChooser chooser("Save trace", File::getSpecialLocation(File::userDocumentsDirectory)
+                            .getChildFile("AsgChrono-trace.json"), "*.json");
+        if (chooser.browseForFileToSave(true) &&
+            !AsgTrace::Export(chooser.getResult().getFullPathName().toRawUTF8()))
+        {
+            AlertWindow::showMessageBoxAsync(AlertWindow::WarningIcon, "Save trace",
+                                             "Failed to write " + chooser.getResult().getFullPathName());
+        }
+    }
 }
 
 // overrides Component ========================================================================
@@ -124,7 +231,9 @@ void MeasureComponent::resized()
 
     // clear button & history
     clearButton->setBounds(area.removeFromTop(60).reduced(BORDER));
-    historyTextBox.setBounds(area.removeFromRight(250).reduced(BORDER));
+    tmpArea = area.removeFromRight(250).reduced(BORDER);
+    historyHeaderLabel.setBounds(tmpArea.removeFromTop(TITLE_LABEL_HEIGHT));
+    historyList.setBounds(tmpArea);
     area.reduce(BORDER, BORDER);
 
     // simple view lables
@@ -138,7 +247,9 @@ void MeasureComponent::resized()
     rofLabel.setBounds(area.removeFromTop(LABEL_HEIGHT));
     area.removeFromTop(SPACER_HEIGHT);
 
-    advancedViewButton.setBounds(area.removeFromBottom(30));
+    tmpArea = area.removeFromBottom(30);
+    saveTraceButton.setBounds(tmpArea.removeFromRight(120));
+    advancedViewButton.setBounds(tmpArea);
     area.removeFromBottom(SPACER_HEIGHT);
 
     advancedViewTextBox.setBounds(area);
@@ -151,6 +262,48 @@ void MeasureComponent::timerCallback()
     UpdateStats();
 }
 
+// overrides AsyncUpdater =====================================================================
+
+void MeasureComponent::handleAsyncUpdate()
+{
+    // new shots are shown immediately, not on the next timer tick
+    UpdateStats();
+}
+
+// overrides ListBoxModel =====================================================================
+
+int MeasureComponent::getNumRows()
+{
+    return static_cast<int>(history.GetSize());
+}
+
+void MeasureComponent::paintListBoxItem(int rowNumber, Graphics& g, int width, int height, bool rowIsSelected)
+{
+    if (rowNumber < 0 || rowNumber >= getNumRows())
+        return;
+
+    if (rowIsSelected)
+        g.fillAll(Colours::lightblue);
+
+    // rows of the shots still kept, numbered since the reset
+    const AsgStatsSample& shot = history[rowNumber];
+    juce::String row = juce::String::formatted("#%-2i", (int)(history.GetDroppedNum() + rowNumber));
+
+    if (shot.velocity > 0.0f)
+        row += juce::String::formatted("   %6.1f", shot.velocity * METERS_TO_FEET);
+    else
+        row += "      N/A";
+
+    if (shot.deltaTime > 0.0f)
+        row += juce::String::formatted("   %6.1f", 60.0f / shot.deltaTime);
+    else
+        row += "      N/A";
+
+    g.setColour(Colours::black);
+    g.setFont(historyFont);
+    g.drawText(row, 4, 0, width - 4, height, Justification::centredLeft, false);
+}
+
 // custom methods =============================================================================
 
 void MeasureComponent::Reset()
@@ -159,41 +312,57 @@ void MeasureComponent::Reset()
     rofLabel.setText("N/A", dontSendNotification);
 
     advancedViewTextBox.setText("");
-    historyTextBox.setText("", false);
+    history.Reset(STATS_HISTORY_SIZE);
+    historyVersion++;
 }
 
 void MeasureComponent::UpdateStats()
 {
-    AsgStats stats;
-    AsgCounterConfig config;
+    ASG_TRACE_THREAD_NAME("GUI");
+    ASG_TRACE_SCOPE("UpdateStats");
 
+    // receive new shots (skip the ones detected before the last reset)
+    ShotRecord record;
+    while (shotsQueue.Pop(shotsReader, record))
     {
-        std::unique_lock<std::mutex> lock(asgStatsLock);
-        stats = counter.GetStats();
-        config = counter.GetConfig();
+        if (record.generation == shownGeneration)
+        {
+            AsgStatsSample sample;
+            sample.velocity = record.event.velocity;
+            sample.deltaTime = record.event.deltaTime;
+            sample.position = record.event.firstPeak;
+            history.Add(sample);
+
+            const ShotTiming& timing = record.timing;
+            if (timing.deviceTime != 0)
+            {
+                detectionLatency.Record(timing.detectionTime - timing.deviceTime);
+                publicationLatency.Record(timing.publicationTime - timing.deviceTime);
+                if (undisplayedShots.size() < undisplayedShots.capacity())
+                    undisplayedShots.push_back(timing.deviceTime);
+            }
+            historyVersion++;
+        }
     }
+    lostShots = shotsReader.GetLostNum();
 
-    stats.Calc(config);
-
-    juce::String historyStr = "#ID      FPS      RoF\n";
-    for (size_t i = 0; i < stats.history.size(); ++i)
+    // only the new rows are painted (if visible)
+    if (historyVersion != shownHistoryVersion)
     {
-        historyStr += juce::String::formatted("#%-2i", i);
-
-        if (stats.history[i].velocity > 0.0f)
-            historyStr += juce::String::formatted("   %6.1f", stats.history[i].velocity * METERS_TO_FEET);
-        else
-            historyStr += "      N/A";
-
-        if (stats.history[i].deltaTime > 0.0f)
-            historyStr += juce::String::formatted("   %6.1f", 60.0f / stats.history[i].deltaTime);
-        else
-            historyStr += "      N/A";
-
-        historyStr += '\n';
+        shownHistoryVersion = historyVersion;
+        historyList.updateContent();
+        if (history.GetSize() > 0)
+            historyList.scrollToEnsureRowIsOnscreen(static_cast<int>(history.GetSize()) - 1);
     }
-    historyTextBox.setText(historyStr, false);
 
+    detectorState.Update();
+    const DetectorState& state = detectorState.Get();
+    const AsgStatsSummary& stats = state.stats;
+    const AsgCounterConfig& config = state.config;
+
+    // the detector has not applied the last reset yet
+    if (state.generation != shownGeneration)
+        return;
 
     juce::String advancedStatsStr;
 
@@ -208,10 +377,49 @@ void MeasureComponent::UpdateStats()
 
         float energy = 0.5f * stats.velocityAvg * stats.velocityAvg * config.mass;
         advancedStatsStr += juce::String::formatted("Energy:             %.3f J\n", energy);
+
+        const float fractions[] = { 0.5f, 0.95f, 0.99f };
+        float percentiles[3];
+        stats.velocitySketch.GetQuantiles(fractions, percentiles, 3);
+        advancedStatsStr += juce::String::formatted("Velocity p50/95/99: %.1f / %.1f / %.1f ft/s\n",
+                                                    percentiles[0] * METERS_TO_FEET,
+                                                    percentiles[1] * METERS_TO_FEET,
+                                                    percentiles[2] * METERS_TO_FEET);
+
+        if (stats.fireRateSketch.GetCount() > 0)
+        {
+            stats.fireRateSketch.GetQuantiles(fractions, percentiles, 3);
+            advancedStatsStr += juce::String::formatted("RoF p50/95/99:      %.1f / %.1f / %.1f BB/min\n",
+                                                        percentiles[0] * 60.0f,
+                                                        percentiles[1] * 60.0f,
+                                                        percentiles[2] * 60.0f);
+        }
+
+        if (energyLimit > 0.0f)
+        {
+            advancedStatsStr += juce::String::formatted("Over %.2f J:        %i shots\n", energyLimit,
+                                                        (int)stats.CountShotsAboveEnergy(energyLimit, config.mass));
+        }
+
+        const AsgStatsSummary& magazine = state.magazineStats;
+        if (magazine.velocityAvg > 0.0f && magazine.shotsNum < stats.shotsNum)
+        {
+            advancedStatsStr += juce::String::formatted("Last magazine:      %i shots, %.1f +- %.1f ft/s\n",
+                                                        (int)magazine.shotsNum,
+                                                        magazine.velocityAvg * METERS_TO_FEET,
+                                                        magazine.velocityStdDev * METERS_TO_FEET);
+        }
     }
     else
         velocityLabel.setText("N/A", dontSendNotification);
 
+    // the display latency ends when the label is painted, even if the text is the same; nothing is
+    // painted while the window is minimized or hidden, such shots are not counted
+    if (!velocityLabel.isShowing())
+        undisplayedShots.clear();
+    else if (!undisplayedShots.empty())
+        velocityLabel.repaint();
+
     if (stats.fireRateAvg > 0.0f)
     {
         rofLabel.setText(juce::String::formatted("%.1f", stats.fireRateAvg * 60.0f), dontSendNotification);
@@ -229,30 +437,268 @@ void MeasureComponent::UpdateStats()
         advancedStatsStr += juce::String::formatted("Power:              %.3f W\n", power);
     }
 
+    if (state.droppedSamples > 0)
+        advancedStatsStr += juce::String::formatted("Dropped samples:    %i\n", (int)state.droppedSamples);
+
+    if (lostShots > 0)
+        advancedStatsStr += juce::String::formatted("Lost shots:         %i\n", (int)lostShots);
+
+    if (displayLatency.GetCount() > 0)
+    {
+        advancedStatsStr += FormatLatency("Detection", detectionLatency);
+        advancedStatsStr += FormatLatency("Publication", publicationLatency);
+        advancedStatsStr += FormatLatency("Display", displayLatency);
+    }
+
     advancedViewTextBox.setText(advancedStatsStr);
 }
 
 void MeasureComponent::UpdateConfig(SetupComponent* setupComponent)
 {
-    std::unique_lock<std::mutex> lock(asgStatsLock);
+    energyLimit = setupComponent->energyLimit;
+
+    // called on every slider move - the session goes on, the detector switches at a block boundary
+    std::unique_lock<std::mutex> lock(requestLock);
+
+    DetectorSettings& settings = requestedSettings;
+    settings.bbMass = setupComponent->bbMass;
+    settings.detectorLength = setupComponent->detectorLength;
+    settings.minVelocity = setupComponent->minVelocity;
+    settings.maxVelocity = setupComponent->maxVelocity;
+    settings.detectionTreshold = setupComponent->detectionTreshold;
+    settings.fireRateTreshold = setupComponent->fireRateTreshold;
+    settings.lowLatency = setupComponent->lowLatency;
+    settingsValid = true;
+    requestedShotLog = setupComponent->shotLog;
+
+    BuildConfigLocked();
+    PublishRequestLocked();
+}
 
-    AsgCounterConfig& cfg = counter.GetConfig();
+void MeasureComponent::OnVelocityPainted()
+{
+    const uint64_t now = AsgTrace::GetTime();
+    for (size_t i = 0; i < undisplayedShots.size(); ++i)
+        displayLatency.Record(now - undisplayedShots[i]);
+    undisplayedShots.clear();
+}
+
+juce::String MeasureComponent::FormatLatency(const char* title, const AsgLatencyHistogram& histogram) const
+{
+    const double NS_TO_MS = 1.0e-6;
+    return juce::String::formatted("%-20s%.1f / %.1f / %.1f ms (p50 / p99 / max of %i)\n",
+                                   (juce::String(title) + " latency:").toRawUTF8(),
+                                   histogram.GetPercentile(0.5) * NS_TO_MS, histogram.GetPercentile(0.99) * NS_TO_MS,
+                                   histogram.GetMax() * NS_TO_MS, (int)histogram.GetCount());
+}
 
-    cfg.mass = setupComponent->bbMass / 1000.0f;
-    cfg.length = 0.01f * setupComponent->detectorLength;
-    cfg.maxPeakDistance = cfg.length * cfg.sampleRate / setupComponent->minVelocity * METERS_TO_FEET;
-    cfg.minPeakDistance = cfg.length * cfg.sampleRate / setupComponent->maxVelocity * METERS_TO_FEET;
+void MeasureComponent::OnAsgEvent(const AsgShotEvent& event)
+{
+    // called on the detector thread, the shots are pushed to the queue after the state is published
+    ShotRecord record;
+    record.event = event;
+    record.generation = generation;
+    record.timing.deviceTime = FindDeviceTime(event.secondPeak >= 0.0 ? event.secondPeak : event.firstPeak);
+    record.timing.detectionTime = AsgTrace::GetTime();
+    record.timing.publicationTime = 0;
+    detectedShots.push_back(record);
+
+    // a long pause starts a new magazine, its first shot has no fire rate
+    if (event.deltaTime < 0.0f || event.deltaTime > MAGAZINE_CHANGE_TIME)
+        magazineStats.Reset();
+    magazineStats.AddSummarySample(event.velocity, magazineStats.shotsNum > 0 ? event.deltaTime : -1.0f,
+                                   counter.GetConfig());
+}
+
+void MeasureComponent::RequestResetLocked()
+{
+    // shots and stats from older generations are ignored from now on
+    shownGeneration = ++requestedGeneration;
+    PublishRequestLocked();
+}
+
+void MeasureComponent::BuildConfigLocked()
+{
+    if (!settingsValid)
+        return;
+
+    const DetectorSettings& settings = requestedSettings;
+    AsgCounterConfig& cfg = requestedConfig;
+
+    cfg.mass = settings.bbMass / 1000.0f;
+    cfg.length = 0.01f * settings.detectorLength;
+    cfg.maxPeakDistance = cfg.length * cfg.sampleRate / settings.minVelocity * METERS_TO_FEET;
+    cfg.minPeakDistance = cfg.length * cfg.sampleRate / settings.maxVelocity * METERS_TO_FEET;
     if (cfg.minPeakDistance > cfg.maxPeakDistance)
         cfg.maxPeakDistance = cfg.minPeakDistance;
 
-    cfg.fireRateTreshold = setupComponent->fireRateTreshold;
-    cfg.detectionSigma = setupComponent->detectionTreshold;
+    cfg.fireRateTreshold = settings.fireRateTreshold;
+    cfg.detectionSigma = settings.detectionTreshold;
 
-    counter.Reset();
-    Reset();
+    if (settings.lowLatency)
+    {
+        // treshold is based on the past samples only (higher detection treshold is recommended)
+        cfg.blockSize = static_cast<size_t>(cfg.sampleRate * LOW_LATENCY_BLOCK_TIME);
+        cfg.rmsWindow = static_cast<size_t>(cfg.sampleRate * LOW_LATENCY_RMS_WINDOW_TIME);
+    }
+    else
+    {
+        AsgCounterConfig defaultConfig;
+        cfg.blockSize = defaultConfig.blockSize;
+        cfg.rmsWindow = defaultConfig.rmsWindow;
+    }
 }
 
-void MeasureComponent::OnAsgEvent()
+void MeasureComponent::PublishRequestLocked()
 {
+    ConfigRequest& request = configRequests.GetWriteBuffer();
+    request.config = requestedConfig;
+    request.version = ++requestedVersion;
+    request.generation = requestedGeneration;
+    request.shotLog = requestedShotLog;
+    configRequests.Publish();
+}
 
+// detector thread ============================================================================
+
+void MeasureComponent::DetectorThreadMain()
+{
+    ASG_TRACE_THREAD_NAME("Detector");
+    std::vector<float> samples(DETECTOR_CHUNK_SIZE);
+
+    while (detectorRunning)
+    {
+        bool stateChanged = false;
+
+        if (configRequests.Update())
+        {
+            ApplyRequests();
+            stateChanged = true;
+        }
+
+        // new shots are collected by OnAsgEvent()
+        size_t samplesNum = samplesRing.Pop(samples.data(), samples.size());
+        FetchCallbackTimes();
+        if (samplesNum > 0)
+            counter.ProcessBuffer(samples.data(), samplesNum);
+        poppedSamples += samplesNum;
+
+        if (stateChanged || !detectedShots.empty())
+            PublishState();
+
+        if (!detectedShots.empty())
+        {
+            const uint64_t publicationTime = AsgTrace::GetTime();
+            for (ShotRecord& record : detectedShots)
+            {
+                record.timing.publicationTime = publicationTime;
+                shotsQueue.Push(record);
+            }
+            detectedShots.clear();
+            triggerAsyncUpdate();
+        }
+
+        if (samplesNum == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void MeasureComponent::FetchCallbackTimes()
+{
+    CallbackTime callbackTime;
+    while (callbackTimes.Pop(callbackTime))
+    {
+        recentCallbacks[recentCallbacksPos] = callbackTime;
+        recentCallbacksPos = (recentCallbacksPos + 1) % recentCallbacks.size();
+    }
+}
+
+uint64_t MeasureComponent::FindDeviceTime(double samplePos)
+{
+    // the audio thread may have pushed the callback time just after the samples
+    FetchCallbackTimes();
+
+    // first callback ending after the sample, searched from the newest one
+    const uint64_t pos = static_cast<uint64_t>(std::max(samplePos, 0.0));
+    uint64_t time = 0;
+    for (size_t i = 1; i <= recentCallbacks.size(); ++i)
+    {
+        const CallbackTime& callbackTime = recentCallbacks[(recentCallbacksPos + recentCallbacks.size() - i) % recentCallbacks.size()];
+        if (callbackTime.endPos <= pos)
+            break;
+        time = callbackTime.time;
+    }
+    return time;
+}
+
+void MeasureComponent::ApplyRequests()
+{
+    // never blocks - the requests are published through the snapshot
+    const ConfigRequest& request = configRequests.Get();
+    if (request.generation != generation)
+    {
+        CloseShotLog();  // every session gets its own log
+        counter.GetConfig() = request.config;
+        counter.Reset(poppedSamples);  // positions stay in samples since the device started
+        loggedShotsNum = 0;
+        magazineStats.Reset();
+        generation = request.generation;
+    }
+    else if (request.version != configVersion)
+    {
+        // keeps the shots, applied at the next block boundary outside of peaks groups
+        counter.SetConfig(request.config);
+    }
+    configVersion = request.version;
+
+    if (request.shotLog && !shotLog.IsOpen())
+        OpenShotLog();
+    else if (!request.shotLog && shotLog.IsOpen())
+        CloseShotLog();
+}
+
+void MeasureComponent::OpenShotLog()
+{
+    File directory = File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("AsgChrono");
+    directory.createDirectory();
+    File file = directory.getNonexistentChildFile("shots-" + Time::getCurrentTime().formatted("%Y%m%d-%H%M%S"), ".asglog", false);
+    JoinShotLog();
+    if (!shotLog.Open(file.getFullPathName().toRawUTF8(), counter.GetConfig()))
+        Logger::writeToLog("Can't create shot log " + file.getFullPathName());
+}
+
+void MeasureComponent::CloseShotLog()
+{
+    if (!shotLog.IsOpen())
+        return;
+
+    // the kept shots are written and the file closed by the log's thread, the detector doesn't wait
+    const AsgShotHistory& history = counter.GetStats().history;
+    shotLog.Finish(history, loggedShotsNum);
+    loggedShotsNum = history.GetDroppedNum() + history.GetSize();
+    shotLogFinishing = true;
+}
+
+void MeasureComponent::JoinShotLog()
+{
+    if (!shotLogFinishing)
+        return;
+
+    // waits only if the last closed log is still being written
+    shotLog.Close();
+    shotLogFinishing = false;
+    if (shotLog.GetDroppedNum() > 0)
+        Logger::writeToLog(juce::String::formatted("Shot log: %i shots dropped", (int)shotLog.GetDroppedNum()));
+}
+
+void MeasureComponent::PublishState()
+{
+    DetectorState& state = detectorState.GetWriteBuffer();
+    const AsgStats& stats = counter.GetStats();
+    state.stats = stats;
+    state.magazineStats = magazineStats;
+    state.config = counter.GetConfig();
+    state.generation = generation;
+    state.droppedSamples = droppedSamples;
+    detectorState.Publish();
 }
\ No newline at end of file
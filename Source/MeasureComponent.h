@@ -1,17 +1,44 @@
 #pragma once
 
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include <string.h>
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "../Builds/AsgChronoLib/Counter.h"
+#include "../Builds/AsgChronoLib/SpscRing.h"
+#include "../Builds/AsgChronoLib/BroadcastRing.h"
+#include "../Builds/AsgChronoLib/Snapshot.h"
+#include "../Builds/AsgChronoLib/ShotLog.h"
+#include "../Builds/AsgChronoLib/Trace.h"
+#include "../Builds/AsgChronoLib/LatencyHistogram.h"
 
 class SetupComponent;
 
+/**
+ * Label calling a function after it's painted (for measuring the display latency).
+ */
+class PaintNotifyingLabel : public Label
+{
+public:
+    std::function<void()> onPaint;
+
+    void paint(Graphics& g) override
+    {
+        Label::paint(g);
+        if (onPaint)
+            onPaint();
+    }
+};
+
 class MeasureComponent
     : public Component
     , public ButtonListener
     , public AudioIODeviceCallback
     , public Timer
+    , public AsyncUpdater
+    , public ListBoxModel
 {
 public:
     MeasureComponent(AudioDeviceManager* audioDeviceManager);
@@ -33,21 +60,134 @@ public:
     // overrides Timer ============================================================================
     void timerCallback() override;
 
+    // overrides AsyncUpdater =====================================================================
+    void handleAsyncUpdate() override;
+
+    // overrides ListBoxModel =====================================================================
+    int getNumRows() override;
+    void paintListBoxItem(int rowNumber, Graphics& g, int width, int height, bool rowIsSelected) override;
+
     // custom methods =============================================================================
     void Reset();
     void UpdateStats();
-    void OnAsgEvent();
+    void OnAsgEvent(const AsgShotEvent& event);
     void UpdateConfig(SetupComponent* setupComponent);
 
 private:
+    // monotonic times (AsgTrace::GetTime()) of the shot processing stages, 0 - unknown
+    struct ShotTiming
+    {
+        uint64_t deviceTime;       // audio callback delivering the second peak
+        uint64_t detectionTime;    // shot reported by the counter
+        uint64_t publicationTime;  // shot and stats published to the GUI
+    };
+
+    struct ShotRecord
+    {
+        AsgShotEvent event;  // positions in samples since the audio device started
+        unsigned int generation;  // counter resets number
+        ShotTiming timing;
+    };
+
+    struct CallbackTime
+    {
+        uint64_t endPos;  // samples pushed including the callback ones
+        uint64_t time;    // start of the callback
+    };
+
+    // detector settings in physical units, converted to samples for the current sample rate
+    struct DetectorSettings
+    {
+        float bbMass;             // [g]
+        float detectorLength;     // [cm]
+        float minVelocity;        // [ft/s]
+        float maxVelocity;        // [ft/s]
+        float detectionTreshold;
+        float fireRateTreshold;
+        bool lowLatency;
+    };
+
+    struct ConfigRequest
+    {
+        AsgCounterConfig config;
+        unsigned int version;     // incremented on every config change
+        unsigned int generation;  // incremented to request counter reset
+        bool shotLog;             // spill the shots to a log
+    };
+
+    struct DetectorState
+    {
+        AsgStatsSummary stats;
+        AsgStatsSummary magazineStats;  // shots since the last magazine change
+        AsgCounterConfig config;
+        unsigned int generation;
+        size_t droppedSamples;
+    };
+
     AudioDeviceManager* audioDeviceManager;
 
     std::vector<float> buffer;
     double sampleRate;
-
-    std::mutex asgStatsLock;
-
+    uint64_t pushedSamples;
+
+    // audio thread -> detector thread
+    AsgSpscRing<float> samplesRing;
+    AsgSpscRing<CallbackTime> callbackTimes;
+    std::atomic<size_t> droppedSamples;
+
+    // detector thread -> GUI thread (and any other consumers of the shots)
+    AsgBroadcastRing<ShotRecord> shotsQueue;
+    AsgSnapshot<DetectorState> detectorState;
+
+    // GUI (or device setup) -> detector thread, the lock serializes the requesting threads only
+    std::mutex requestLock;
+    AsgSnapshot<ConfigRequest> configRequests;
+    DetectorSettings requestedSettings;
+    bool settingsValid;  // false until the first UpdateConfig()
+    AsgCounterConfig requestedConfig;
+    unsigned int requestedVersion;
+    unsigned int requestedGeneration;
+    bool requestedShotLog;
+
+    // owned by the detector thread
+    std::thread detectorThread;
+    std::atomic<bool> detectorRunning;
     AsgCounter counter;
+    unsigned int configVersion;
+    unsigned int generation;
+    uint64_t poppedSamples;
+    std::vector<CallbackTime> recentCallbacks;  // ring of the last callback times
+    size_t recentCallbacksPos;
+    std::vector<ShotRecord> detectedShots;  // since the last state publishing
+    AsgStats magazineStats;  // shots since the last magazine change, without history
+    AsgShotLogWriter shotLog;  // shots spilled from the stats history, the kept ones at the end of a session
+    uint64_t loggedShotsNum;  // shots of the session in the logs closed so far, not logged again
+    bool shotLogFinishing;  // closed log possibly still written by its thread
+
+    // owned by the GUI thread
+    AsgBroadcastRing<ShotRecord>::Reader shotsReader;
+    AsgShotHistory history;  // last STATS_HISTORY_SIZE shots received from the detector
+    uint64_t lostShots;
+    unsigned int shownGeneration;
+    float energyLimit;  // [J], 0 - not checked
+    unsigned int historyVersion;  // incremented when shots are added or cleared
+    unsigned int shownHistoryVersion;
+    AsgLatencyHistogram detectionLatency, publicationLatency, displayLatency;  // since the device callback
+    std::vector<uint64_t> undisplayedShots;  // device times of the shots received but not painted yet, up to the reserved capacity
+
+    void DetectorThreadMain();
+    void FetchCallbackTimes();
+    uint64_t FindDeviceTime(double samplePos);
+    void ApplyRequests();
+    void OpenShotLog();
+    void CloseShotLog();
+    void JoinShotLog();
+    void PublishState();
+    void RequestResetLocked();
+    void BuildConfigLocked();
+    void PublishRequestLocked();
+    void OnVelocityPainted();
+    juce::String FormatLatency(const char* title, const AsgLatencyHistogram& histogram) const;
 
     Font font;
 
@@ -58,13 +198,17 @@ private:
     * Energy, power
     */
 
-    Label velocityTitleLabel, velocityLabel;
+    Label velocityTitleLabel;
+    PaintNotifyingLabel velocityLabel;  // its paint ends the shot-to-display latency
     Label rofTitleLabel, rofLabel;
 
     TextEditor advancedViewTextBox;
 
     ToggleButton advancedViewButton;
+    TextButton saveTraceButton;  // only with tracing compiled in
     bool advancedView;
-    TextEditor historyTextBox;
+    Font historyFont;
+    Label historyHeaderLabel;
+    ListBox historyList;  // paints the visible rows only
     ScopedPointer<Button> clearButton;
 };
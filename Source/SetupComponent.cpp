@@ -34,6 +34,39 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SetupFloatProperty)
 };
 
+class SetupBoolProperty
+    : public BooleanPropertyComponent
+{
+public:
+    SetupBoolProperty(SetupComponent* setupComponent,
+                      bool* valuePtr, const String& propertyName, bool initialValue)
+        : BooleanPropertyComponent(propertyName, "On", "Off")
+        , setupComponent(setupComponent)
+        , valuePtr(valuePtr)
+    {
+        *valuePtr = initialValue;
+        refresh();
+    }
+
+    void setState(bool newState) override
+    {
+        *valuePtr = newState;
+        refresh();
+        setupComponent->OnSettingChanged();
+    }
+
+    bool getState() const override
+    {
+        return *valuePtr;
+    }
+
+private:
+    SetupComponent* setupComponent;
+    bool* valuePtr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SetupBoolProperty)
+};
+
 
 SetupComponent::SetupComponent(MeasureComponent* measureComponent)
     : measureComponent(measureComponent)
@@ -47,6 +80,7 @@ SetupComponent::SetupComponent(MeasureComponent* measureComponent)
             Array<PropertyComponent*> comps;
             comps.add(new SetupFloatProperty(this, &bbMass, "BB mass [g]", 0.0f, 10.0f, 0.0f, 0.2f));
             comps.add(new SetupFloatProperty(this, &detectorLength, "Detector length [cm]", 1.0f, 100.0f, 0.1f, 20.0f));
+            comps.add(new SetupFloatProperty(this, &energyLimit, "Energy limit [J]", 0.0f, 5.0f, 0.01f, 0.0f));
             propertyPanel.addSection("Measurement variables", comps);
         }
 
@@ -54,8 +88,10 @@ SetupComponent::SetupComponent(MeasureComponent* measureComponent)
             Array<PropertyComponent*> comps;
             comps.add(new SetupFloatProperty(this, &minVelocity, "Min. velocity [ft/s]", 50.0f, 1000.0f, 1.0f, 100.0f));
             comps.add(new SetupFloatProperty(this, &maxVelocity, "Max. velocity [ft/s]", 50.0f, 1000.0f, 1.0f, 600.0f));
-            comps.add(new SetupFloatProperty(this, &detectionTreshold, "Peak detection treshold", 1.0f, 20.0f, 0.01f, 7.0f));
+            comps.add(new SetupFloatProperty(this, &detectionTreshold, "Peak detection treshold", 1.0f, 50.0f, 0.01f, 7.0f));
             comps.add(new SetupFloatProperty(this, &fireRateTreshold, "Fire rate treshold", 1.0f, 3.0f, 0.01f, 1.25f));
+            comps.add(new SetupBoolProperty(this, &lowLatency, "Low latency detection", false));
+            comps.add(new SetupBoolProperty(this, &shotLog, "Shot log (Documents/AsgChrono)", false));
             propertyPanel.addSection("Detection options", comps);
         }
     }
@@ -72,6 +108,11 @@ void SetupComponent::resized()
 }
 
 void SetupComponent::sliderValueChanged(Slider* slider)
+{
+    OnSettingChanged();
+}
+
+void SetupComponent::OnSettingChanged()
 {
     measureComponent->UpdateConfig(this);
 }
\ No newline at end of file
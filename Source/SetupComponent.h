@@ -16,15 +16,23 @@ public:
     void resized() override;
     void sliderValueChanged(Slider* slider) override;
 
+    /**
+     * Called when any of the settings changes.
+     */
+    void OnSettingChanged();
+
 private:
     MeasureComponent* measureComponent;
 
     float bbMass;             // [g]
     float detectorLength;     // [cm]
+    float energyLimit;        // [J], 0 - not checked
     float minVelocity;        // [ft/s]
     float maxVelocity;        // [ft/s]
     float detectionTreshold;
     float fireRateTreshold;
+    bool lowLatency;
+    bool shotLog;             // spill old shots to a log in the documents folder
 
     PropertyPanel propertyPanel;
 };